@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "scgbe.h"
+
+// Joypad state (active low, see Joypad::set_inputs) to apply from a given frame onwards.
+typedef std::map<uint64_t, uint8_t> InputScript;
+
+class BatchSession {
+
+    private:
+    std::unique_ptr<GBSystem> _gb;
+    uint64_t _frame_limit;
+
+    public:
+    InputScript input_script;
+    std::vector<int16_t> audio; // Interleaved L/R samples, requires an APU sample interval to be set
+    std::string error;          // Set if the session was stopped by an exception
+
+    BatchSession(const std::vector<uint8_t>& rom, uint64_t frames);
+
+    void run_frame();
+
+    bool finished() const {
+        return _gb->frame_number >= _frame_limit || !error.empty();
+    }
+
+    GBSystem& gb() {
+        return *_gb;
+    }
+};
+
+class BatchRunner {
+
+    private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> sessions;
+    };
+
+    std::vector<std::unique_ptr<BatchSession>> _sessions;
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::atomic<size_t> _remaining {0};
+    std::atomic<uint64_t> _steals {0};
+
+    // Idle workers wait on this rather than spin, for a requeue that leaves a session to
+    // steal, counted by _work_generation, or for the last session to finish
+    std::mutex _idle_mutex;
+    std::condition_variable _work_available;
+    std::atomic<uint64_t> _work_generation {0};
+    std::atomic<unsigned> _idle_workers {0};
+    unsigned _thread_count;
+
+    public:
+    // Called on a worker thread after every frame of a session. Different sessions
+    // may be reported from different threads at the same time.
+    std::function<void(size_t, BatchSession&)> on_frame;
+    uint32_t frames_per_quantum = 1;
+
+    BatchRunner(unsigned threads = 0);
+
+    size_t add_session(const std::vector<uint8_t>& rom, uint64_t frames);
+    void run();
+
+    BatchSession& session(size_t index) {
+        return *_sessions[index];
+    }
+
+    size_t session_count() const {
+        return _sessions.size();
+    }
+
+    unsigned thread_count() const {
+        return _thread_count;
+    }
+
+    uint64_t steals() const {
+        return _steals;
+    }
+
+    private:
+    void worker(unsigned index);
+    bool pop_local(unsigned worker, size_t& session);
+    bool steal(unsigned worker, size_t& session);
+};
\ No newline at end of file
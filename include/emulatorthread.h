@@ -1,23 +1,34 @@
 #pragma once
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <memory>
 #include <vector>
 #include <SFML/Audio.hpp>
+#include <wx/rawbmp.h>
 #include <wx/thread.h>
-#include "gbsystem.h"
+#include "sound/ratecontrol.h"
+#include "scgbe.h"
 #include "soundstreamer.h"
 
+// Where wxAlphaPixelData keeps alpha last, the RGBA frames are handed over with their color
+// bytes already in its order, so the display panel can copy them a row at a time.
+constexpr bool FRAME_NATIVE_LAYOUT = (wxAlphaPixelFormat::ALPHA == 3) && (wxAlphaPixelFormat::BitsPerPixel == 32);
+
 class EmulatorThread : public wxThread {
 
+    // Finished frames, as RGBA or see FRAME_NATIVE_LAYOUT, on their way to the display panel
+    FrameExchange _frames = FrameExchange(SCREEN_W * SCREEN_H * 4);
     std::unique_ptr<GBSystem> _gb;
     uint64_t _pause_after_frame = -1;
     bool _rom_valid = false;
     std::chrono::_V2::system_clock::time_point _emulation_start_time;
     double _fps = 59.7275f;
-    double _audio_sample_timer = 0;
 
     SoundStreamer _sound_stream;
+    RateControl _sound_rate;
+    std::atomic<double> _sound_rate_factor {1.0}; // From _sound_rate, for the next frame's samples
+    std::atomic<uint32_t> _audio_latency_ms {SOUND_DEFAULT_LATENCY_MS};
 
     public:
     EmulatorThread(std::vector<uint8_t>& rom);
@@ -28,6 +39,8 @@ class EmulatorThread : public wxThread {
     void unpause();
     void next_frame();
     void set_fps(double fps);
+    // Takes effect from the next frame, restarting the audio stream.
+    void set_audio_latency(uint32_t latency_ms);
 
     bool rom_valid() const {
         return _rom_valid;
@@ -37,6 +50,19 @@ class EmulatorThread : public wxThread {
         return *_gb;
     }
 
+    FrameExchange& frames() {
+        return _frames;
+    }
+
+    SoundStreamer& sound_stream() {
+        return _sound_stream;
+    }
+
+    // How much faster than nominal samples are being made, to keep the stream's buffer steady.
+    double sound_rate_factor() const {
+        return _sound_rate_factor.load(std::memory_order_relaxed);
+    }
+
     bool paused() const {
         return _gb->frame_number > _pause_after_frame;
     }
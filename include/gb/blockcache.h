@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class CPU;
+class GBSystem;
+
+// An instruction decoded ahead of time, with everything CPU::execute needs to run it.
+struct DecodedInstruction {
+    const uint8_t* code; // Host memory it was decoded from, nullptr marks the end of a block
+    uint8_t (*handler)(CPU& cpu);
+    uint8_t length;
+    uint8_t cycles; // Cost if no branch is taken, the handler returns the actual one
+    uint8_t operands[2];
+    uint8_t idle_loop_cycles; // Cost of one iteration if a polling loop starts here, 0 otherwise
+};
+
+struct BlockCacheStats {
+    uint64_t hits = 0;          // Instructions run from a decoded block
+    uint64_t misses = 0;        // Instructions fetched byte by byte instead
+    uint64_t blocks_built = 0;
+    uint64_t invalidations = 0; // Blocks dropped because their code was written to
+
+    double hit_rate() const {
+        uint64_t total = hits + misses;
+        return total ? (double) hits / total : 0;
+    }
+};
+
+// Predecoded basic blocks, keyed by the host memory holding their code. ROM banks and
+// RAM each live in their own buffers, so the key tells apart the same PC in different
+// banks, and a bank switch only changes which blocks are looked up.
+// Blocks never cross a 256 byte page. RAM pages holding code are write protected
+// through the page table, a write to one drops every block on it.
+class BlockCache {
+
+    private:
+    static constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+    struct CodePage {
+        std::vector<DecodedInstruction> blocks[0x100]; // By the offset of their first instruction
+    };
+
+    GBSystem& gb;
+    std::unordered_map<uintptr_t, std::unique_ptr<CodePage>> _pages; // By the host address of the page
+    const DecodedInstruction* _next = nullptr; // Instruction following the last one run
+    size_t _block_count = 0;
+    bool _enabled = true;
+
+    public:
+    BlockCacheStats stats;
+
+    BlockCache(GBSystem& gb_param);
+
+    // Returns the decoded instruction at address, whose code is at the given host memory.
+    const DecodedInstruction* fetch(uint16_t address, const uint8_t* code) {
+        const DecodedInstruction* instruction = _next;
+        if (!instruction || instruction->code != code) {
+            instruction = lookup(address, code);
+            if (!instruction) {
+                stats.misses++;
+                return nullptr;
+            }
+        }
+        stats.hits++;
+        _next = instruction + 1;
+        return instruction;
+    }
+
+    // Drops every block on the page holding address, whose code is at the given host memory.
+    void invalidate(uint16_t address, const uint8_t* code);
+    void clear();
+
+    bool enabled() const {
+        return _enabled;
+    }
+
+    void set_enabled(bool enabled) {
+        _enabled = enabled;
+        _next = nullptr;
+    }
+
+    size_t block_count() const {
+        return _block_count;
+    }
+
+    private:
+    const DecodedInstruction* lookup(uint16_t address, const uint8_t* code);
+
+    static uintptr_t page_key(uint16_t address, const uint8_t* code) {
+        return (uintptr_t) code - (address & 0xFF);
+    }
+};
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include "savestate.h"
 
 #include <iostream>
 
@@ -73,6 +74,12 @@ class Cartridge {
     bool _rtc_latched = false;
     uint8_t _latched_rtc_value = 0;
 
+    // Currently mapped banks, recalculated whenever an MBC register changes.
+    // SRAM is nullptr when accesses need special handling (MBC2, RTC registers).
+    const uint8_t* _rom_banks[2];
+    const uint8_t* _sram_read_bank = nullptr;
+    uint8_t* _sram_write_bank = nullptr;
+
     public:
     Cartridge(GBSystem& gb);
 
@@ -81,7 +88,23 @@ class Cartridge {
     uint8_t read_address(uint16_t address);
     void write_address(uint16_t address, uint8_t value);
 
+    // Host memory backing the given 256 byte page, or nullptr if accesses
+    // have to go through read_address/write_address.
+    const uint8_t* read_page(uint16_t address) const;
+    uint8_t* write_page(uint16_t address);
+
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     const CartridgeHeader& header() const {
         return *_header;
     }
+
+    const std::vector<uint8_t>& rom() const {
+        return _rom;
+    }
+
+    private:
+    uint32_t rom_address(uint16_t address) const;
+    void update_banks();
 };
\ No newline at end of file
@@ -1,29 +1,165 @@
 #pragma once
+#include <array>
 #include <cstdint>
+#include <utility>
+#include "blockcache.h"
 #include "instructions.h"
+#include "jit.h"
+#include "recompiled.h"
 #include "gbcomponent.h"
 #include "utils.h"
 
-struct Flags {
-    bool zero, subtraction, half_carry, carry;
+namespace FlagOp {
+    enum FlagOp : uint8_t {
+        None, // Flags are stored as they are in _f
+        Add,  // ADD/ADC: _lhs + _rhs + _carry_in
+        Sub,  // SUB/SBC/CP: _lhs - _rhs - _carry_in
+        And,
+        Or,   // OR and XOR
+        Inc,  // INC r: carry kept in _carry_in
+        Dec   // DEC r: carry kept in _carry_in
+    };
+}
+
+// Z/N/H/C, evaluated lazily. ALU instructions only record their operands, and a flag
+// is worked out when something reads it (a conditional branch, PUSH AF, DAA, ADC/SBC...).
+// Most flags are overwritten before that ever happens.
+class Flags {
+
+    private:
+    FlagOp::FlagOp _op = FlagOp::None;
+    uint8_t _f = 0;
+    uint8_t _lhs = 0;
+    uint8_t _rhs = 0;
+    uint8_t _carry_in = 0;
+    uint8_t _result = 0;
+
+    public:
+    bool zero() const {
+        return _op == FlagOp::None ? (_f & 0x80) != 0 : _result == 0;
+    }
+
+    bool subtraction() const {
+        switch (_op) {
+        case FlagOp::None: return (_f & 0x40) != 0;
+        case FlagOp::Sub:
+        case FlagOp::Dec: return true;
+        default: return false;
+        }
+    }
+
+    bool half_carry() const {
+        switch (_op) {
+        case FlagOp::Add: return ((_lhs & 0xF) + (_rhs & 0xF) + _carry_in) & 0x10;
+        case FlagOp::Sub: return ((_lhs & 0xF) - (_rhs & 0xF) - _carry_in) & 0x10;
+        case FlagOp::And: return true;
+        case FlagOp::Or: return false;
+        case FlagOp::Inc: return (_lhs & 0xF) == 0xF;
+        case FlagOp::Dec: return (_lhs & 0xF) == 0;
+        default: return (_f & 0x20) != 0;
+        }
+    }
+
+    bool carry() const {
+        switch (_op) {
+        case FlagOp::Add: return _lhs + _rhs + _carry_in > 0xFF;
+        case FlagOp::Sub: return _lhs < _rhs + _carry_in;
+        case FlagOp::And:
+        case FlagOp::Or: return false;
+        case FlagOp::Inc:
+        case FlagOp::Dec: return _carry_in;
+        default: return (_f & 0x10) != 0;
+        }
+    }
+
+    void set_zero(bool value) {
+        materialize();
+        _f = utils::set_bit_value(_f, 7, value);
+    }
+
+    void set_subtraction(bool value) {
+        materialize();
+        _f = utils::set_bit_value(_f, 6, value);
+    }
+
+    void set_half_carry(bool value) {
+        materialize();
+        _f = utils::set_bit_value(_f, 5, value);
+    }
+
+    void set_carry(bool value) {
+        materialize();
+        _f = utils::set_bit_value(_f, 4, value);
+    }
+
+    void set_all(bool zero, bool subtraction, bool half_carry, bool carry) {
+        _op = FlagOp::None;
+        _f = (zero << 7) | (subtraction << 6) | (half_carry << 5) | (carry << 4);
+    }
+
+    // Returns the result of the operation.
+    uint8_t record_add(uint8_t lhs, uint8_t rhs, uint8_t carry_in) {
+        _op = FlagOp::Add;
+        _lhs = lhs;
+        _rhs = rhs;
+        _carry_in = carry_in;
+        _result = lhs + rhs + carry_in;
+        return _result;
+    }
+
+    uint8_t record_sub(uint8_t lhs, uint8_t rhs, uint8_t carry_in) {
+        _op = FlagOp::Sub;
+        _lhs = lhs;
+        _rhs = rhs;
+        _carry_in = carry_in;
+        _result = lhs - rhs - carry_in;
+        return _result;
+    }
+
+    void record_and(uint8_t result) {
+        _op = FlagOp::And;
+        _result = result;
+    }
+
+    void record_or(uint8_t result) {
+        _op = FlagOp::Or;
+        _result = result;
+    }
+
+    uint8_t record_inc(uint8_t value) {
+        _carry_in = carry();
+        _op = FlagOp::Inc;
+        _lhs = value;
+        _result = value + 1;
+        return _result;
+    }
+
+    uint8_t record_dec(uint8_t value) {
+        _carry_in = carry();
+        _op = FlagOp::Dec;
+        _lhs = value;
+        _result = value - 1;
+        return _result;
+    }
 
     uint8_t to_byte() const {
-        uint8_t result = 0;
-        result = utils::set_bit_value(result, 7, zero);
-        result = utils::set_bit_value(result, 6, subtraction);
-        result = utils::set_bit_value(result, 5, half_carry);
-        result = utils::set_bit_value(result, 4, carry);
-        return result;
+        if (_op == FlagOp::None) {
+            return _f;
+        }
+        return (zero() << 7) | (subtraction() << 6) | (half_carry() << 5) | (carry() << 4);
     }
 
     static Flags from_byte(uint8_t value) {
         Flags flags;
-        flags.zero = utils::get_bit_value(value, 7);
-        flags.subtraction = utils::get_bit_value(value, 6);
-        flags.half_carry = utils::get_bit_value(value, 5);
-        flags.carry = utils::get_bit_value(value, 4);
+        flags._f = value & 0xF0;
         return flags;
     }
+
+    private:
+    void materialize() {
+        _f = to_byte();
+        _op = FlagOp::None;
+    }
 };
 
 struct Registers {
@@ -83,6 +219,11 @@ struct Registers {
         l = (uint8_t) (value);
     }
 
+    bool operator==(const Registers& other) const {
+        return a == other.a && f() == other.f() && b == other.b && c == other.c && d == other.d
+            && e == other.e && h == other.h && l == other.l && sp == other.sp && pc == other.pc;
+    }
+
     void clear() {
         a = 0;
         b = 0;
@@ -99,30 +240,128 @@ struct Registers {
 
 class CPU : public GBComponent {
 
+    // Generated code works on the CPU's state directly
+    friend class Jit;
+    friend class RecompiledCode;
+    friend class RecompiledContext;
+
     private:
-    uint8_t _interrupt_flags = 0;
+    uint8_t _interrupt_flags = 0;   // IF
+    uint8_t _interrupt_enable = 0;  // IE
+    uint8_t _pending_interrupts = 0; // IF & IE & 0x1F, updated whenever either changes
     bool _ime_flag = false;
     bool _ime_enable_next_cycle = false;
     bool _halted = false;
+    uint8_t _operands[2]; // Immediates of the instruction being run
+    uint8_t _block_exit_requested = 0;
+    BlockCache _block_cache;
+    Jit _jit;
+    RecompiledCode _recompiled;
 
     public:
     Registers registers;
     bool halt_bug = false;
 
-    uint8_t wait_ticks = 0;
-
     CPU(GBSystem& gb_param);
 
-    void tick();
+    uint8_t step();
     void reset();
 
     uint8_t execute();
     uint8_t check_for_interrupts();
 
+    bool halted() const {
+        return _halted;
+    }
+
+    // Halted, and nothing but a new interrupt request can change that.
+    bool waiting_for_interrupt() const {
+        return _halted && !_ime_enable_next_cycle && !_pending_interrupts;
+    }
+
+    uint8_t interrupt_enable() const {
+        return _interrupt_enable;
+    }
+
+    void set_interrupt_enable(uint8_t value) {
+        _interrupt_enable = value;
+        _pending_interrupts = _interrupt_flags & value & 0x1F;
+    }
+
+    // Sets the interrupt's bit in IF. Returns false if it was already set.
+    bool request_interrupt(uint8_t interrupt) {
+        bool newly_requested = !(_interrupt_flags & interrupt);
+        set_interrupt_flags(_interrupt_flags | interrupt);
+        return newly_requested;
+    }
+
+    // Runs a single already fetched opcode through the handler tables.
+    uint8_t execute_opcode(uint8_t opcode);
+    // Same as execute_opcode, but through the original runtime-decoding switch. Only
+    // defined in scgbe-opbench (src/bench/cpureference.cpp), not in the core library.
+    uint8_t execute_reference(uint8_t opcode);
+
+    // Decodes the instruction at code, which must hold all of its bytes.
+    static void decode(const uint8_t* code, DecodedInstruction& instruction);
+    static uint8_t instruction_length(uint8_t opcode);
+    static bool valid_opcode(uint8_t opcode);
+    // Jumps, calls, returns, HALT and STOP.
+    static bool ends_block(uint8_t opcode);
+
+    BlockCache& block_cache() {
+        return _block_cache;
+    }
+
+    Jit& jit() {
+        return _jit;
+    }
+
+    RecompiledCode& recompiled() {
+        return _recompiled;
+    }
+
+    // Makes natively run code return after its current instruction.
+    void request_block_exit() {
+        _block_exit_requested = 1;
+    }
+
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     private:
+    typedef uint8_t (*OpcodeHandler)(CPU& cpu);
+
+    void set_interrupt_flags(uint8_t value) {
+        _interrupt_flags = value & 0x1F;
+        _pending_interrupts = _interrupt_flags & _interrupt_enable;
+    }
+
+    uint8_t execute_cb_opcode(uint8_t opcode);
+    static OpcodeHandler opcode_handler(uint8_t opcode);
+    static OpcodeHandler cb_opcode_handler(uint8_t opcode);
+
+    // One handler is generated per opcode, with its operands decoded at compile time.
+    template <uint8_t OPCODE> uint8_t instruction();
+    template <uint8_t OPCODE> uint8_t cb_instruction();
+    template <bool CB, uint8_t OPCODE> static uint8_t handle_opcode(CPU& cpu);
+    template <bool CB, size_t... OPCODES>
+    static constexpr std::array<OpcodeHandler, sizeof...(OPCODES)> make_handler_table(std::index_sequence<OPCODES...>);
+
+    template <uint8_t OPERATION> void alu_operation(uint8_t value);
+    template <uint8_t OPERATION> uint8_t rotate_shift(uint8_t value, bool& shifted_out_bit);
+
+    template <ByteRegister::ByteRegister REGISTER> uint8_t get_register_byte();
+    template <ByteRegister::ByteRegister REGISTER> void set_register_byte(uint8_t value);
+    template <WordRegister::WordRegister REGISTER> uint16_t get_register_word();
+    template <WordRegister::WordRegister REGISTER> void set_register_word(uint16_t value);
+    template <Condition::Condition CONDITION> bool check_condition();
+    uint16_t immediate_word() const {
+        return (((uint16_t) _operands[1]) << 8) | _operands[0];
+    }
+
     uint8_t read_cpu_register_byte(ByteRegister::ByteRegister target);
     void read_cpu_register_byte(ByteRegister::ByteRegister target, uint8_t value);
 
@@ -10,11 +10,15 @@ class DMAController : public GBComponent {
     public:
     DMAController(GBSystem& gb);
 
-    void tick();
+    void sync(uint64_t cycle);
+    void reset_sync_cycle();
 
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     bool active() const {
         return _counter < 160;
     }
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct FrameExchangeStats {
+    uint64_t published = 0;
+    uint64_t presented = 0;
+    uint64_t dropped = 0;    // Replaced by a newer frame before the consumer took them
+    uint64_t duplicated = 0; // Times the consumer asked for a frame and got the last one again
+};
+
+// Triple buffer between the emulator thread and a presenter thread. The producer fills
+// the back buffer and swaps it with the middle one, the consumer swaps the middle buffer
+// for its front one when a newer frame is there. Neither side ever waits on the other.
+// Only one producer thread and one consumer thread may use it.
+class FrameExchange {
+
+    private:
+    static constexpr uint8_t FRESH_FRAME = 0x80; // Set on _middle until the consumer takes it
+
+    std::vector<uint8_t> _buffers[3];
+    std::atomic<uint8_t> _middle {1};
+    uint8_t _back = 0;  // Only touched by the producer
+    uint8_t _front = 2; // Only touched by the consumer
+
+    std::atomic<uint64_t> _published {0};
+    std::atomic<uint64_t> _presented {0};
+    std::atomic<uint64_t> _dropped {0};
+    std::atomic<uint64_t> _duplicated {0};
+
+    public:
+    FrameExchange(size_t frame_size);
+
+    size_t frame_size() const {
+        return _buffers[0].size();
+    }
+
+    // Producer: the buffer to draw the next frame into, then hand it over with publish().
+    uint8_t* back_buffer() {
+        return _buffers[_back].data();
+    }
+
+    void publish();
+    // Copies frame_size() bytes into the back buffer and publishes them.
+    void publish(const uint8_t* frame);
+
+    // Consumer: the latest published frame. It stays valid until the next acquire().
+    const uint8_t* acquire();
+
+    // Can be read from any thread.
+    FrameExchangeStats stats() const;
+};
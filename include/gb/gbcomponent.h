@@ -1,5 +1,6 @@
 #pragma once
 #include "registers.h"
+#include "savestate.h"
 
 class GBSystem;
 
@@ -7,6 +8,10 @@ class GBComponent {
     public:
     GBSystem& gb;
 
+    protected:
+    // First system cycle this component has not simulated yet.
+    uint64_t _sync_cycle = 0;
+
     public:
     GBComponent(GBSystem& gb_param) :
         gb(gb_param)
@@ -14,8 +19,27 @@ class GBComponent {
 
     }
 
-    virtual void tick() = 0;
+    // Catch the component up to (and including) the given system cycle.
+    virtual void sync(uint64_t cycle) {}
+
+    // Starts the component's timeline over at system cycle 0, for a reset, and schedules
+    // its next deadline from there.
+    virtual void reset_sync_cycle() {
+        _sync_cycle = 0;
+    }
 
     virtual uint8_t read_io_register(uint16_t address) { return 0xFF; }
     virtual void write_io_register(uint16_t address, uint8_t value) {}
+
+    virtual void save_state(StateWriter& state) const {
+        state.write(_sync_cycle);
+    }
+
+    virtual void load_state(StateReader& state) {
+        state.read(_sync_cycle);
+    }
+
+    uint64_t sync_cycle() const {
+        return _sync_cycle;
+    }
 };
\ No newline at end of file
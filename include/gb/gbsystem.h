@@ -1,22 +1,48 @@
 #pragma once
 #include <cstdint>
 #include <initializer_list>
+#include <memory>
 #include <string>
 #include <fstream>
-#include "apu.h"
+#include <vector>
+#include "sound/apu.h"
 #include "cartridge.h"
 #include "cpu.h"
 #include "dmacontroller.h"
 #include "joypad.h"
 #include "ppu.h"
+#include "scheduler.h"
 #include "timer.h"
 
 constexpr uint16_t RST_VECTORS = 0x0000;
 constexpr uint16_t INTERRUPT_VECTORS = 0x0040;
 constexpr uint16_t DMA_DEST = 0xFE00;
 
+namespace CPUBackend {
+    enum CPUBackend {
+        Interpreter,
+        JIT,               // Hot blocks run as native code
+        JITLockstep,       // JIT, checked against a copy of the system run by the interpreter
+        Recompiled,        // C++ generated ahead of time by scgbe-recompile, linked in for the ROM
+        RecompiledLockstep // Recompiled, checked the same way as JITLockstep
+    };
+}
+
+// Guest time fast-forwarded instead of being stepped through.
+struct SkipStats {
+    uint64_t halt_cycles = 0;            // CPU halted with no interrupt pending
+    uint64_t last_frame_halt_cycles = 0; // Same, during the last frame run_frame() completed
+    uint64_t idle_loop_cycles = 0;       // CPU polling memory that can't change yet
+    uint64_t last_frame_idle_loop_cycles = 0;
+};
+
 class GBSystem {
 
+    // Generated code reads the cycle count and deadlines directly
+    friend class Jit;
+    friend class RecompiledCode;
+    friend class RecompiledContext;
+
     private:
     Cartridge _cartridge = Cartridge(*this);
     CPU _cpu = CPU(*this);
@@ -30,22 +56,115 @@ class GBSystem {
     uint8_t _wram[WRAM_SIZE * WRAM_BANKS]; // Only 2 banks in DMG mode
     uint8_t _hram[HRAM_SIZE];
 
+    // Host memory for each 256 byte page of the address space, nullptr if the
+    // page needs the slow path (IO, OAM, MBC registers, blocked by DMA or the PPU...)
+    const uint8_t* _read_pages[0x100];
+    uint8_t* _write_pages[0x100];
+
+    // RAM pages with decoded code in the CPU's block cache. Writes to them go through
+    // the slow path, which drops the blocks.
+    bool _wram_code_pages[WRAM_SIZE * WRAM_BANKS / 0x100] = {};
+    bool _hram_code = false;
+
+    Scheduler _scheduler;
+    uint64_t _next_frame_cycle = 0;
+    bool _syncing = false;
+
+    // Last visit to the head of a polling loop, see skip_idle_loop()
+    struct IdleLoopVisit {
+        const uint8_t* code = nullptr;
+        uint64_t cycle = 0;
+        uint64_t deadline = 0;
+    };
+    bool _idle_loop_skipping = false;
+    IdleLoopVisit _idle_loop;
+    uint64_t _run_until_cycle = 0;
+
+    CPUBackend::CPUBackend _cpu_backend = CPUBackend::Interpreter;
+    std::unique_ptr<GBSystem> _lockstep; // Interpreter-run copy for the lockstep backends
+
     public:
     uint32_t clock_speed = 4194304;
     uint64_t cycles = 0;
-    uint64_t frame_cycles = 0;
-    uint8_t timer_cycles = 0;
     uint64_t frame_number = 0;
+    SkipStats skip_stats;
 
     GBComponent* register_handlers[0x80];
 
     GBSystem(bool cgb);
 
-    bool tick();
+    void run_frame();
+    void run_until(uint64_t cycle);
+    void sync_to(uint64_t cycle);
     void reset();
 
-    uint8_t read_address(uint16_t addr, bool internal = false);
-    void write_address(uint16_t addr, uint8_t value, bool internal = false);
+    // Set after loading the ROM. Recompiled throws std::runtime_error if no module was
+    // linked in for it. The lockstep backends copy the whole system, and throw
+    // std::runtime_error from run_frame/run_until as soon as the two disagree.
+    void set_cpu_backend(CPUBackend::CPUBackend backend);
+
+    CPUBackend::CPUBackend cpu_backend() const {
+        return _cpu_backend;
+    }
+
+    // Fast-forwards loops that poll memory (LY, STAT, IF, RAM...) until the next
+    // scheduled event, which is the earliest the value could change. Off by default.
+    // Only the interpreter detects them, through the block cache.
+    void set_idle_loop_skipping(bool enabled) {
+        _idle_loop_skipping = enabled;
+        _idle_loop = IdleLoopVisit();
+    }
+
+    bool idle_loop_skipping() const {
+        return _idle_loop_skipping;
+    }
+
+    // Called by the CPU at the head of a polling loop. Returns whether cycles moved on,
+    // in which case the loop hasn't run and run_until catches up before it does.
+    bool skip_idle_loop(const DecodedInstruction& head);
+
+    // Reusing the same vector between saves avoids reallocating it.
+    void save_state(std::vector<uint8_t>& state);
+    // Throws std::invalid_argument if the state doesn't fit this system, leaving it as it was.
+    void load_state(const std::vector<uint8_t>& state);
+
+    uint8_t read_address(uint16_t address, bool internal = false) {
+        const uint8_t* page = _read_pages[address >> 8];
+        if (page) {
+            return page[address & 0xFF];
+        }
+        return read_address_slow(address, internal);
+    }
+
+    void write_address(uint16_t address, uint8_t value, bool internal = false) {
+        uint8_t* page = _write_pages[address >> 8];
+        if (page) {
+            page[address & 0xFF] = value;
+            return;
+        }
+        write_address_slow(address, value, internal);
+    }
+
+    // Host memory holding the code at address, or nullptr if it can't be cached right now.
+    const uint8_t* code_pointer(uint16_t address) const {
+        if (address >= HRAM_START) {
+            return _hram + (address - HRAM_START);
+        }
+        if (address >= VRAM_START && address < WRAM_BANK0_START) {
+            // VRAM and SRAM can be written to behind the page table's back
+            return nullptr;
+        }
+        const uint8_t* page = _read_pages[address >> 8];
+        return page ? page + (address & 0xFF) : nullptr;
+    }
+
+    // Write protects the RAM page at address, which now has code in the block cache.
+    void protect_code(uint16_t address);
+    // Empties the block cache, e.g. after memory was replaced wholesale.
+    void flush_code_cache();
+
+    // Rebuilds the page table for the given (inclusive) address range.
+    void update_memory_map(uint16_t start_address = 0x0000, uint16_t end_address = 0xFFFF);
 
     void add_register_callbacks(GBComponent* component, std::initializer_list<uint16_t> addresses);
     void add_register_callbacks_range(GBComponent* component, uint16_t address_start, uint16_t address_end_exclusive);
@@ -79,7 +198,26 @@ class GBSystem {
         return _cartridge;
     }
 
+    Scheduler& scheduler() {
+        return _scheduler;
+    }
+
+    uint32_t cycles_per_frame() const {
+        return (uint32_t) (clock_speed / 59.7275);
+    }
+
     bool cgb_mode() const {
         return _cgb;
     }
+
+    private:
+    uint8_t read_address_slow(uint16_t address, bool internal);
+    void write_address_slow(uint16_t address, uint8_t value, bool internal);
+    void update_wram_page(uint16_t wram_address);
+    void check_lockstep();
+    bool skip_halt(uint64_t cycle);
+    void read_state_header(StateReader& reader);
+    void read_state(StateReader& reader);
+    // Puts every component back at cycle 0, with its deadline scheduled.
+    void restart_components();
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCGBE_JIT_X64
+#endif
+
+class CPU;
+class GBSystem;
+
+struct JitStats {
+    uint64_t blocks_compiled = 0;
+    uint64_t block_runs = 0;
+    uint64_t instructions = 0; // Instructions run as native code
+    uint64_t flushes = 0;      // Times the code buffer filled up and was emptied
+};
+
+// Translates hot basic blocks to x86-64. Most instructions become a call to their
+// handler with the immediates and PC update baked in, simple register loads, 16 bit
+// INC/DEC and unconditional jumps are emitted inline.
+// After each instruction the block adds its cycles to GBSystem::cycles and leaves as
+// soon as the interpreter loop would have done something else: reaching the end of
+// the run or a scheduler deadline, a pending interrupt, EI, or memory changing under
+// it (writes to code, bank switches, DMA...). Blocks share the BlockCache's keys and
+// RAM write protection, and are dropped along with its pages.
+class Jit {
+
+    private:
+    typedef uint32_t (*BlockFunction)();
+
+    static constexpr size_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t MAX_BLOCK_LENGTH = 64;
+    static constexpr size_t MAX_INSTRUCTION_SIZE = 256; // Generous upper bound, exits included
+    static constexpr uint16_t HOT_THRESHOLD = 16;       // Interpreted runs before a block is compiled
+
+    struct JitPage {
+        BlockFunction blocks[0x100] = {};
+        uint16_t heat[0x100] = {};
+    };
+
+    GBSystem& gb;
+    CPU& _cpu;
+    std::unordered_map<uintptr_t, std::unique_ptr<JitPage>> _pages;
+
+    uint8_t* _code = nullptr;
+    size_t _code_used = 0;
+    bool _enabled = false;
+
+    uint64_t _until = 0; // Read by the generated code
+
+    public:
+    JitStats stats;
+
+    Jit(GBSystem& gb_param, CPU& cpu);
+    ~Jit();
+
+    static bool available();
+
+    // Throws if the platform is unsupported or executable memory can't be allocated.
+    void set_enabled(bool enabled);
+
+    bool enabled() const {
+        return _enabled;
+    }
+
+    // Runs the compiled block at PC, if there is one, stopping before cycle `until`.
+    // Returns the number of instructions run, 0 if the interpreter has to take this step.
+    uint32_t run(uint64_t until);
+
+    void invalidate(uint16_t address, const uint8_t* code);
+    void clear();
+
+    private:
+    BlockFunction compile(uint16_t address, const uint8_t* code);
+};
\ No newline at end of file
@@ -5,17 +5,29 @@ class Joypad : public GBComponent {
 
     private:
     uint8_t _current_register = 0xFF;
+    uint8_t _inputs = 0xFF; // Active low: Start, Select, B, A, Down, Up, Left, Right
     bool _selected_dpad = false;
     bool _selected_buttons = false;
 
     public:
     Joypad(GBSystem& gb);
 
-    void tick();
+    void sync(uint64_t cycle);
 
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
+    void set_inputs(uint8_t inputs) {
+        _inputs = inputs;
+    }
+
+    uint8_t inputs() const {
+        return _inputs;
+    }
+
     private:
     void update_joypad();
 
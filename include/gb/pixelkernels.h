@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCGBE_PIXEL_SIMD_X86
+#endif
+
+// Sprite row bytes, as composited over the background: 0 where no sprite pixel is
+// drawn, otherwise the palette mapped color with these flags set.
+constexpr uint8_t SPRITE_PIXEL_OPAQUE = 0x80;
+constexpr uint8_t SPRITE_PIXEL_BEHIND_BG = 0x40; // Only shows over background color 0
+
+// The PPU's pixel loops, in a scalar version and SIMD versions for the hosts that have
+// them. best() picks the fastest one the CPU running the emulator supports.
+struct PixelKernels {
+    const char* name;
+
+    // The 8 color indices (0-3) of a planar tile row, leftmost pixel first.
+    void (*decode_row)(uint8_t lsb, uint8_t msb, uint8_t* out);
+    // out[i] = palette[indices[i]]
+    void (*map_palette)(const uint8_t* indices, const uint8_t* palette, uint8_t* out, size_t count);
+    // Maps the background color indices through bg_palette and draws the sprite row over
+    // them, following the OBJ-to-BG priority bit.
+    void (*composite)(const uint8_t* bg, const uint8_t* sprites, const uint8_t* bg_palette, uint8_t* out, size_t count);
+    // Shades (0-3) to packed output pixels: out[i] = lut[shades[i]]
+    void (*map_rgba32)(const uint8_t* shades, const uint32_t* lut, uint32_t* out, size_t count);
+    void (*map_rgb565)(const uint8_t* shades, const uint16_t* lut, uint16_t* out, size_t count);
+
+    static const PixelKernels& scalar();
+    static const PixelKernels& best();
+    // Every version this host can run, scalar first.
+    static std::vector<const PixelKernels*> available();
+};
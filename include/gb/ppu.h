@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
+#include "frameexchange.h"
 #include "gbcomponent.h"
 #include "memorymap.h"
+#include "pixelkernels.h"
+#include "tilecache.h"
 #include "utils.h"
 
 constexpr uint8_t SCREEN_W = 160;
@@ -36,6 +39,14 @@ namespace LCDDrawMode {
     };
 }
 
+namespace OutputFormat {
+    enum OutputFormat {
+        None = 0,     // Only the 0-3 shade framebuffer
+        RGBA8888 = 1, // R, G, B and A bytes per pixel
+        RGB565 = 2    // A native endian uint16_t per pixel
+    };
+}
+
 struct OAMEntry {
     uint8_t y_position;
     uint8_t x_position;
@@ -72,6 +83,13 @@ struct OAMEntry {
     }
 };
 
+struct PPUStats {
+    uint64_t fast_lines = 0; // Drawn in one go once mode 3 ended
+    uint64_t slow_lines = 0; // Drawn dot by dot, after a mid-line write or with the fast path off
+    uint64_t rendered_frames = 0;
+    uint64_t skipped_frames = 0; // Left out by frame skip or with rendering off
+};
+
 class PPU : public GBComponent {
 
     private:
@@ -117,17 +135,50 @@ class PPU : public GBComponent {
     bool _window_penalty = false;
     uint8_t _last_drawn_sprite_tile_x = -1;
     bool _was_disabled = false;
+    bool _vram_accessible = true;
+
+    // Scanline fast path: the line's pixels are left alone during mode 3 and drawn all at
+    // once when it ends, unless something they depend on is written to in the meantime.
+    bool _scanline_rendering = true;
+    const PixelKernels* _pixel_kernels = &PixelKernels::best();
+    bool _scanline_deferred = false;
+    // The penalty checks of the current dot have run against the current state, so the
+    // remaining penalty dots can be skipped.
+    bool _penalties_checked = false;
+
+    // The current line's sprites, rasterized once OAM scan is done: 0 where there is no
+    // sprite pixel, otherwise its palette mapped color and SPRITE_PIXEL_* flags.
+    uint8_t _sprite_row[SCREEN_W];
+    bool _sprite_row_valid = false; // Cleared by writes that could change it mid-line
+
+    // Frame skip: frames that aren't drawn still run every mode and penalty, only the
+    // pixels are left out. Decided at the start of each frame.
+    bool _rendering = true;
+    uint32_t _frame_skip = 0;
+    uint32_t _frames_until_render = 0;
+    bool _render_frame = true;
+
+    // Packed copy of the framebuffer, brought up to date as each scanline is finished.
+    OutputFormat::OutputFormat _output_format = OutputFormat::None;
+    uint32_t _output_palette[4] = { 0xFFFFFF, 0xAAAAAA, 0x555555, 0x000000 };
+    uint32_t _output_lut32[4];
+    uint16_t _output_lut16[4];
+    std::vector<uint8_t> _output_frame;
+    FrameExchange* _frame_exchange = nullptr;
 
     // VRAM
     uint8_t _vram[VRAM_SIZE * VRAM_BANKS]; // Only 1 bank in DMG mode
     uint8_t _oam[OAM_SIZE];
+    TileCache _tiles = TileCache(_vram);
 
     public:
     uint8_t framebuffer[SCREEN_W * SCREEN_H]; // Stored as 0-3 intensity values. Can be more memory efficient if packed, but... eh...
+    PPUStats stats;
 
     PPU(GBSystem& gb);
 
-    void tick();
+    void sync(uint64_t cycle);
+    void reset_sync_cycle();
 
     uint8_t read_address(uint16_t address, bool internal = false);
     void write_address(uint16_t address, uint8_t value, bool internal = false);
@@ -135,6 +186,9 @@ class PPU : public GBComponent {
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     bool enabled() const {
         return _enabled;
     }
@@ -143,6 +197,107 @@ class PPU : public GBComponent {
         return _mode;
     }
 
+    // Whether the CPU can currently access VRAM, i.e. not in mode 3.
+    bool vram_accessible() const {
+        return _vram_accessible;
+    }
+
+    uint8_t* vram_page(uint16_t address) {
+        return _vram + (address - VRAM_START);
+    }
+
+    // Tile data writes have to go through write_address, to keep the tile cache up to date.
+    uint8_t* vram_write_page(uint16_t address) {
+        return (address - VRAM_START) < TILE_DATA_SIZE ? nullptr : vram_page(address);
+    }
+
+    // Turns the scanline fast path on or off, drawing every line dot by dot when off.
+    void set_scanline_rendering(bool enabled);
+
+    bool scanline_rendering() const {
+        return _scanline_rendering;
+    }
+
+    // Only draws one frame out of every frames + 1, the framebuffer keeps the last one
+    // drawn in between. Takes effect from the next frame on, which is drawn.
+    void set_frame_skip(uint32_t frames);
+
+    uint32_t frame_skip() const {
+        return _frame_skip;
+    }
+
+    // With rendering off the framebuffer is never drawn to. Timing, STAT and interrupts
+    // are exactly the same either way. Takes effect from the next frame on.
+    void set_rendering(bool enabled);
+
+    bool rendering() const {
+        return _rendering;
+    }
+
+    // Whether the frame currently being drawn ends up in the framebuffer.
+    bool rendering_frame() const {
+        return _render_frame;
+    }
+
+    // Keeps a ready to display copy of the framebuffer in this format, converted through
+    // the output palette one scanline at a time. None (the default) turns it off.
+    void set_output_format(OutputFormat::OutputFormat format);
+
+    OutputFormat::OutputFormat output_format() const {
+        return _output_format;
+    }
+
+    // The colors of shades 0-3 as 0xRRGGBB, white to black by default.
+    void set_output_palette(const uint32_t (&colors)[4]);
+
+    // SCREEN_W * SCREEN_H pixels in the output format, row by row, or nullptr with none.
+    const uint8_t* output_frame() const {
+        return _output_frame.empty() ? nullptr : _output_frame.data();
+    }
+
+    size_t output_frame_size() const {
+        return _output_frame.size();
+    }
+
+    // Publishes every frame drawn to the exchange when it enters VBlank: the output frame
+    // with an output format set, the framebuffer otherwise. The exchange's frame size has
+    // to match, and it has to outlive the PPU or be detached with nullptr.
+    void set_frame_exchange(FrameExchange* exchange);
+
+    // The SIMD version picked for this host is used by default.
+    void set_pixel_kernels(const PixelKernels& kernels);
+
+    const PixelKernels& pixel_kernels() const {
+        return *_pixel_kernels;
+    }
+
     protected:
+    void tick();
+    void schedule_next_event();
+    void update_vram_access();
+
+    bool compare_interrupt_line() const {
+        return _compare_scanline_interrupt_select && (_current_scanline == _compare_scanline);
+    }
+
     uint8_t get_pixel_of_tile(uint16_t tile_addr, uint8_t x, uint8_t y) ;
+    uint16_t tile_data_address(uint8_t tile_index) const;
+
+    // Draws pixels [start_x, end_x) of the current line with the current state.
+    void render_pixels(uint8_t start_x, uint8_t end_x);
+    // Has to run before anything the current line depends on is written to.
+    void before_render_state_change();
+    void build_sprite_row();
+    void start_frame();
+    // Converts framebuffer lines [first_line, end_line) into the output frame.
+    void output_lines(uint8_t first_line, uint8_t end_line);
+    size_t published_frame_size() const;
+
+    const uint8_t* sprite_row() {
+        if (!_sprite_row_valid) {
+            build_sprite_row();
+        }
+        return _sprite_row;
+    }
+    void end_drawing();
 };
\ No newline at end of file
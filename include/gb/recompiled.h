@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class GBSystem;
+class RecompiledContext;
+
+// Runs the instructions of a translated block from the given entry point on, and
+// returns how many it ran.
+typedef uint32_t (*RecompiledFunction)(RecompiledContext& context, uint32_t entry);
+
+// A translated instruction, by its offset in the ROM file.
+struct RecompiledEntry {
+    uint32_t rom_offset;
+    RecompiledFunction function;
+    uint32_t entry;
+};
+
+// C++ generated by scgbe-recompile for one ROM.
+struct RecompiledModule {
+    const char* name;
+    uint64_t rom_hash;
+    uint32_t rom_size;
+    const RecompiledEntry* entries;
+    size_t entry_count;
+
+    static uint64_t hash_rom(const uint8_t* data, size_t size);
+};
+
+// Generated modules register themselves through a static instance of this, so linking
+// one in is enough for it to be used for its ROM.
+class RecompiledModuleRegistration {
+
+    public:
+    RecompiledModuleRegistration(const RecompiledModule& module);
+};
+
+struct RecompiledStats {
+    uint64_t block_runs = 0;
+    uint64_t instructions = 0; // Instructions run as translated code
+};
+
+// Runs translated code for the loaded ROM, if a module was linked in for it. The
+// interpreter takes over for everything the translation doesn't cover: code in RAM,
+// jump targets it could not resolve, interrupts and HALT.
+class RecompiledCode {
+
+    public:
+    struct Slot {
+        RecompiledFunction function;
+        uint32_t entry;
+    };
+
+    private:
+    GBSystem& gb;
+    const RecompiledModule* _module = nullptr;
+    const std::vector<Slot>* _slots = nullptr; // By ROM offset, shared by every instance
+
+    public:
+    RecompiledStats stats;
+
+    RecompiledCode(GBSystem& gb_param);
+
+    // Picks the module registered for this ROM, if there is one.
+    void load_rom(const std::vector<uint8_t>& rom);
+
+    const RecompiledModule* module() const {
+        return _module;
+    }
+
+    // Runs the translated code at PC, if there is some, stopping before cycle `until`.
+    // Returns the number of instructions run, 0 if the interpreter has to take this step.
+    uint32_t run(uint64_t until);
+};
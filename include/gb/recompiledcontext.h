@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include "gbsystem.h"
+#include "recompiled.h"
+
+// What code generated by scgbe-recompile works with. Instructions that are simple enough
+// are written out in the generated C++ on top of these, the rest call the interpreter's
+// handler. Memory goes through the same GBSystem accessors as the interpreter.
+class RecompiledContext {
+
+    private:
+    GBSystem& gb;
+    CPU& cpu;
+    uint64_t _until;
+
+    public:
+    Registers& r;
+
+    RecompiledContext(GBSystem& gb_param, uint64_t until) :
+        gb(gb_param),
+        cpu(gb_param.cpu()),
+        _until(until),
+        r(gb_param.cpu().registers)
+    {}
+
+    // Whether the interpreter loop has something to do before the next instruction.
+    bool stop() const {
+        return gb.cycles >= _until || gb.cycles >= gb.scheduler().next_deadline();
+    }
+
+    // Same, after an instruction that touched memory, IO or the interrupt state.
+    bool stop_after_access() const {
+        return stop() || cpu._block_exit_requested || cpu._ime_enable_next_cycle
+            || (cpu._ime_flag && cpu._pending_interrupts);
+    }
+
+    void tick(uint8_t cycles) {
+        gb.cycles += cycles * 4;
+    }
+
+    uint8_t read(uint16_t address) {
+        return gb.read_address(address);
+    }
+
+    void write(uint16_t address, uint8_t value) {
+        gb.write_address(address, value);
+    }
+
+    void push(uint16_t value) {
+        gb.write_address(--r.sp, value >> 8);
+        gb.write_address(--r.sp, value & 0xFF);
+    }
+
+    uint16_t pop() {
+        uint8_t lsb = gb.read_address(r.sp++);
+        uint8_t msb = gb.read_address(r.sp++);
+        return (((uint16_t) msb) << 8) | lsb;
+    }
+
+    // Runs the interpreter's handler for opcode. PC must already point past the instruction.
+    uint8_t call(uint8_t opcode, uint8_t operand0 = 0, uint8_t operand1 = 0) {
+        cpu._operands[0] = operand0;
+        cpu._operands[1] = operand1;
+        return CPU::opcode_handler(opcode)(cpu);
+    }
+};
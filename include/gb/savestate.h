@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+constexpr uint32_t SAVE_STATE_MAGIC = 0x53424753; // "SGBS"
+constexpr uint16_t SAVE_STATE_VERSION = 5;
+
+// Appends raw values to a save state blob. Everything is stored in host byte order,
+// save states are meant for fast snapshots, not for sharing between machines.
+class StateWriter {
+
+    private:
+    std::vector<uint8_t>& _data;
+
+    public:
+    StateWriter(std::vector<uint8_t>& data) :
+        _data(data)
+    {
+
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written to a save state");
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_bytes(const void* source, size_t length) {
+        size_t offset = _data.size();
+        _data.resize(offset + length);
+        std::memcpy(_data.data() + offset, source, length);
+    }
+};
+
+class StateReader {
+
+    private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _offset = 0;
+
+    public:
+    StateReader(const std::vector<uint8_t>& data) :
+        _data(data.data()),
+        _size(data.size())
+    {
+
+    }
+
+    template <typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read from a save state");
+        read_bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        read(value);
+        return value;
+    }
+
+    void read_bytes(void* destination, size_t length) {
+        if (length > _size - _offset) {
+            throw std::invalid_argument("Save state is truncated");
+        }
+        std::memcpy(destination, _data + _offset, length);
+        _offset += length;
+    }
+
+    size_t remaining() const {
+        return _size - _offset;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,6 @@
+#pragma once
+
+// Public entry point of the scgbe_core library. Frontends should only need
+// to include this header and link against scgbe_core.
+#include "gbsystem.h"
+#include "utils.h"
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include "savestate.h"
+
+constexpr uint64_t NO_DEADLINE = UINT64_MAX;
+
+namespace SchedulerEvent {
+    enum SchedulerEvent {
+        PPU = 0,   // Next PPU mode change / scanline change
+        Timer = 1, // Next TIMA overflow
+        DMA = 2,   // End of an OAM DMA transfer
+        Count
+    };
+}
+
+class Scheduler {
+
+    // Generated code compares against the next deadline directly
+    friend class Jit;
+
+    private:
+    uint64_t _deadlines[SchedulerEvent::Count];
+    uint64_t _next_deadline = NO_DEADLINE;
+
+    public:
+    Scheduler();
+
+    void schedule(SchedulerEvent::SchedulerEvent event, uint64_t cycle);
+    void cancel(SchedulerEvent::SchedulerEvent event);
+    void clear();
+
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
+    uint64_t deadline(SchedulerEvent::SchedulerEvent event) const {
+        return _deadlines[event];
+    }
+
+    // Earliest cycle at which any component needs to be caught up.
+    uint64_t next_deadline() const {
+        return _next_deadline;
+    }
+
+    private:
+    void update_next_deadline();
+};
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
+#include <vector>
 #include "gbcomponent.h"
 #include "noisechannel.h"
 #include "pulsechannel.h"
 #include "registers.h"
+#include "soundmixer.h"
 #include "wavechannel.h"
 
 class APU : public GBComponent {
@@ -15,8 +17,13 @@ class APU : public GBComponent {
     bool _vin_right = true;
     uint8_t _right_volume = 8;
 
+    // Output sampling, in system cycles per stereo sample
+    double _sample_interval = 0;
+    SoundMixer _mixer;
+
     public:
     uint8_t div_apu = 0;
+    std::vector<int16_t> sample_buffer; // Interleaved left/right samples, drained by the frontend
 
     PulseChannel pulse_channel_1 = PulseChannel(SND_P1_ORIGIN, true);
     PulseChannel pulse_channel_2 = PulseChannel(SND_P2_ORIGIN, false);
@@ -25,12 +32,21 @@ class APU : public GBComponent {
 
     APU(GBSystem& gb);
 
-    void tick();
+    void sync(uint64_t cycle);
+    void reset_sync_cycle();
     void div_tick();
 
-    int16_t current_sample(bool right_channel);
+    // Samples are band-limited to the output rate. 0 (the default) turns them off.
+    void set_sample_interval(double cycles);
 
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
+    protected:
+    // Brings the mixer up to date with the channels' outputs and the panning and volume,
+    // after anything other than a channel's timer changed them.
+    void update_mixer(uint64_t cycle);
 };
\ No newline at end of file
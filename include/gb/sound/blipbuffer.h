@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr int BLIP_KERNEL_WIDTH = 16; // Output samples each step is spread over
+constexpr int BLIP_PHASE_BITS = 6;    // Sub-sample positions a step can land on
+constexpr int BLIP_PHASES = 1 << BLIP_PHASE_BITS;
+constexpr int BLIP_KERNEL_BITS = 12;  // Each phase of the kernel adds up to 1 << BLIP_KERNEL_BITS
+constexpr int BLIP_FRACTION_BITS = 32; // Of sample positions
+constexpr size_t BLIP_COMPACT_SAMPLES = 4096; // Read samples kept before they're erased
+
+// Band-limited step synthesis, blip_buf style: changes in amplitude are added as deltas at
+// the cycle they happen on, and smeared over a few output samples with a windowed sinc.
+// Reading the samples back integrates the deltas, so a square wave comes out without the
+// aliasing that point sampling it would cause. Everything is in integers, so the output
+// can't drift from the levels that were put in. Output lags BLIP_KERNEL_WIDTH / 2 samples.
+// Left and right are kept together, they always share a timeline.
+class BlipBuffer {
+
+    private:
+    std::vector<int64_t> _deltas; // Left/right pairs
+    size_t _read_offset = 0;      // Pair that's the next sample to be read
+    int64_t _sums[2] = {0, 0};
+    uint64_t _samples_per_cycle = 0; // Fixed point, BLIP_FRACTION_BITS
+    // Where _base_cycle falls, in fixed point samples from the next sample to be read
+    uint64_t _base_cycle = 0;
+    uint64_t _base_position = 0;
+
+    public:
+    // Starts over with no samples and a level of 0, cycle being the time of sample 0.
+    void clear(double cycles_per_sample, uint64_t cycle);
+    // Changes the output rate from the given cycle onwards.
+    void set_rate(double cycles_per_sample, uint64_t cycle);
+
+    // cycle can't be before the last one passed to read_samples.
+    void add_delta(uint64_t cycle, int64_t left, int64_t right);
+
+    // Same, as a plain step from the output sample this cycle falls in onwards, for a signal
+    // that's already been filtered down to one level per output sample. Same delay.
+    void add_sample_delta(uint64_t cycle, int64_t left, int64_t right) {
+        size_t index = (position(cycle) >> BLIP_FRACTION_BITS) + (BLIP_KERNEL_WIDTH / 2) - 1;
+        int64_t* deltas = reserve(index + 1) + (index * 2);
+        deltas[0] += left << BLIP_KERNEL_BITS;
+        deltas[1] += right << BLIP_KERNEL_BITS;
+    }
+
+    // First cycle that falls in the output sample after the one this cycle falls in.
+    uint64_t next_sample_cycle(uint64_t cycle) const {
+        return first_cycle_at(((position(cycle) >> BLIP_FRACTION_BITS) + 1) << BLIP_FRACTION_BITS);
+    }
+
+    // First cycle that falls in the same output sample as this one.
+    uint64_t sample_start_cycle(uint64_t cycle) const {
+        return first_cycle_at((position(cycle) >> BLIP_FRACTION_BITS) << BLIP_FRACTION_BITS);
+    }
+
+    // Reads the samples that no delta from this cycle onwards can change anymore, into out as
+    // interleaved left/right pairs, divided by 1 << shift and clamped to 16 bits.
+    void read_samples(uint64_t cycle, std::vector<int16_t>& out, int shift);
+
+    private:
+    uint64_t position(uint64_t cycle) const {
+        return _base_position + (cycle - _base_cycle) * _samples_per_cycle;
+    }
+
+    uint64_t first_cycle_at(uint64_t sample_position) const {
+        if (sample_position <= _base_position) {
+            return _base_cycle;
+        }
+        return _base_cycle + ((sample_position - _base_position + _samples_per_cycle - 1) / _samples_per_cycle);
+    }
+
+    // Makes sure there's room for this many samples past the next one to be read, and returns
+    // that one.
+    int64_t* reserve(size_t samples) {
+        if (_deltas.size() < (_read_offset + samples) * 2) {
+            _deltas.resize((_read_offset + samples) * 2, 0);
+        }
+        return _deltas.data() + (_read_offset * 2);
+    }
+};
@@ -20,7 +20,7 @@ class NoiseChannel : public SoundChannel {
     public:
     NoiseChannel(uint16_t base_address);
 
-    void tick();
+    void advance(uint64_t cycle, uint32_t cycles);
     void trigger();
 
     int16_t current_sample();
@@ -29,4 +29,14 @@ class NoiseChannel : public SoundChannel {
     void write_io_register(uint16_t address, uint8_t value);
 
     void clear_registers();
+
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
+    private:
+    void step_lsfr();
+    // Steps the LSFR this many times, and returns how many of them started out at a shifted
+    // value of 1.
+    uint64_t step_lsfr(uint64_t steps);
+    int16_t sample_for(bool shifted_value) const;
 };
\ No newline at end of file
@@ -24,7 +24,7 @@ class PulseChannel : public SoundChannel {
     public:
     PulseChannel(uint16_t base_address, bool has_frequency_sweep);
 
-    void tick();
+    void advance(uint64_t cycle, uint32_t cycles);
     void div_tick(uint8_t div_apu);
 
     int16_t current_sample();
@@ -36,5 +36,11 @@ class PulseChannel : public SoundChannel {
 
     void clear_registers();
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     uint16_t calculate_sweep_period();
+
+    private:
+    void step_duty_cycle(uint32_t steps);
 };
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+// Keeps a buffer that's filled by the emulator and drained by an audio device at a target
+// depth, even though the two run on separate clocks that never quite agree. Each update
+// returns a factor to scale the rate samples are produced at by, never more than
+// max_adjustment away from 1, which is too little to hear as a change in pitch.
+// A proportional term corrects short swings, and an integral one learns the steady
+// difference between the clocks, so the depth settles on the target instead of next to it.
+class RateControl {
+
+    private:
+    double _max_adjustment;
+    double _average_fill = -1; // Smoothed over a few updates, < 0 until the first one
+    double _drift = 0;         // The integral term
+
+    public:
+    RateControl(double max_adjustment);
+
+    // Forgets everything learned, like after a pause or a change in target.
+    void reset();
+
+    // fill and target are in the same units, usually samples.
+    double update(double fill, double target);
+
+    double average_fill() const {
+        return _average_fill < 0 ? 0 : _average_fill;
+    }
+
+    // The clock difference learned so far, as a rate factor.
+    double drift() const {
+        return 1 + _drift;
+    }
+};
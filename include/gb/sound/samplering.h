@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SampleRingStats {
+    uint64_t written = 0;   // Stereo samples that made it in
+    uint64_t read = 0;
+    uint64_t overruns = 0;  // Writes that didn't fit, the samples that didn't are dropped
+    uint64_t underruns = 0; // Reads that came up short
+    uint64_t dropped = 0;   // Samples lost to overruns
+    uint64_t missing = 0;   // Samples that underrunning reads asked for and didn't get
+};
+
+// Fixed size ring of interleaved left/right samples, between the emulator thread writing a
+// frame's worth at a time and the audio thread reading a chunk at a time. Neither side ever
+// waits on or allocates for the other. Only one producer thread and one consumer thread
+// may use it.
+class SampleRing {
+
+    private:
+    std::vector<int16_t> _samples;
+    size_t _mask; // Capacity is a power of two, in stereo samples
+
+    // Stereo samples written/read so far. Each is only advanced by its own side, and kept on
+    // its own cache line so the two don't keep stealing it from each other.
+    alignas(64) std::atomic<uint64_t> _write_position {0};
+    alignas(64) std::atomic<uint64_t> _read_position {0};
+
+    alignas(64) std::atomic<uint64_t> _overruns {0};
+    std::atomic<uint64_t> _underruns {0};
+    std::atomic<uint64_t> _dropped {0};
+    std::atomic<uint64_t> _missing {0};
+
+    public:
+    // Rounds capacity up to a power of two stereo samples.
+    SampleRing(size_t capacity);
+
+    size_t capacity() const {
+        return _mask + 1;
+    }
+
+    // Stereo samples waiting to be read. From the producer it's an upper bound, since the
+    // consumer may be reading, and from the consumer a lower bound, since the producer may be
+    // writing. Any other thread gets an estimate between 0 and capacity().
+    size_t fill() const {
+        // Read position first: it never passes the write position, so the write position
+        // loaded after it can't be behind it. It can be ahead by more than the capacity though,
+        // if both sides moved on in between.
+        uint64_t read_position = _read_position.load(std::memory_order_acquire);
+        uint64_t write_position = _write_position.load(std::memory_order_acquire);
+        return (size_t) std::min<uint64_t>(write_position - read_position, capacity());
+    }
+
+    size_t free() const {
+        return capacity() - fill();
+    }
+
+    // Producer: copies up to count stereo samples in, as left/right pairs, and returns how
+    // many fit.
+    size_t write(const int16_t* samples, size_t count);
+
+    // Consumer: copies up to count stereo samples out and returns how many there were.
+    size_t read(int16_t* samples, size_t count);
+    // Consumer, or the producer while nothing is reading: throws away everything waiting.
+    void discard();
+
+    // Can be read from any thread.
+    SampleRingStats stats() const;
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include <cstdint>
+#include "savestate.h"
+#include "soundmixer.h"
 
 class SoundChannel {
 
@@ -21,6 +23,10 @@ class SoundChannel {
     uint8_t _volume_sweep_timer = 0;
     uint8_t _length_timer = 0;
 
+    // Where changes in current_sample() go, only set while the APU is producing samples
+    SoundMixer* _mixer = nullptr;
+    uint8_t _mixer_channel = 0;
+
     public:
     SoundChannel(uint16_t base_address) :
         _base_address(base_address)
@@ -28,7 +34,8 @@ class SoundChannel {
 
     }
 
-    virtual void tick() = 0;
+    // Run the channel's frequency timer for the given number of cycles, starting at cycle.
+    virtual void advance(uint64_t cycle, uint32_t cycles) = 0;
     virtual void div_tick(uint8_t div_apu);
 
     virtual int16_t current_sample() = 0;
@@ -39,7 +46,22 @@ class SoundChannel {
     virtual void write_io_register(uint16_t address, uint8_t value) = 0;
     virtual void clear_registers() = 0;
 
+    virtual void save_state(StateWriter& state) const;
+    virtual void load_state(StateReader& state);
+
     bool active() const {
         return _dac_enabled && _active;
     }
+
+    void set_mixer(SoundMixer* mixer, uint8_t channel) {
+        _mixer = mixer;
+        _mixer_channel = channel;
+    }
+
+    // Passes the channel's current output on to the mixer, as of this cycle.
+    void update_output(uint64_t cycle) {
+        if (_mixer) {
+            _mixer->set_level(_mixer_channel, cycle, current_sample());
+        }
+    }
 };
\ No newline at end of file
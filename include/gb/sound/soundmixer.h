@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "blipbuffer.h"
+
+constexpr uint8_t SOUND_CHANNELS = 4;
+constexpr uint8_t SOUND_NOISE_CHANNEL = 3;
+
+// Mixes the four channels into band-limited left and right outputs. Channels report their
+// level whenever it changes, and panning/master volume changes re-weigh the current levels,
+// each at the cycle it happens on.
+class SoundMixer {
+
+    private:
+    BlipBuffer _output;
+    int16_t _levels[SOUND_CHANNELS] = {};
+    // Panning times (master volume + 1), the output is divided by 8 again when it's read
+    int32_t _gains[2][SOUND_CHANNELS] = {};
+
+    // The noise channel is box filtered instead: its level is averaged over the cycles of each
+    // output sample, and the average goes in as one plain step. _levels holds the last average.
+    int16_t _noise_level = 0;
+    uint64_t _noise_cycle = 0;         // Up to where _noise_area covers
+    uint64_t _noise_sample_start = 0;  // Cycles of the output sample being averaged
+    uint64_t _noise_sample_end = 0;
+    int64_t _noise_area = 0;           // Level times cycles
+
+    public:
+    // Starts over at a level of 0, with output sample 0 at the given cycle.
+    void reset(double cycles_per_sample, uint64_t cycle);
+    void set_rate(double cycles_per_sample, uint64_t cycle);
+
+    void set_level(uint8_t channel, uint64_t cycle, int16_t level) {
+        if (channel == SOUND_NOISE_CHANNEL) {
+            set_noise_level(cycle, level);
+            return;
+        }
+
+        int32_t change = level - _levels[channel];
+        if (change == 0) {
+            return;
+        }
+        _levels[channel] = level;
+        int64_t left = (int64_t) change * _gains[0][channel];
+        int64_t right = (int64_t) change * _gains[1][channel];
+        if (!left && !right) {
+            return;
+        }
+        _output.add_delta(cycle, left, right);
+    }
+
+    void set_noise_level(uint64_t cycle, int16_t level) {
+        if (cycle >= _noise_sample_end) {
+            finish_noise_samples(cycle);
+        }
+        _noise_area += (int64_t) _noise_level * (int64_t) (cycle - _noise_cycle);
+        _noise_cycle = cycle;
+        _noise_level = level;
+    }
+
+    // The noise channel can step every 8 cycles, far more often than there are output
+    // samples. It sums up the levels it held between steps within one output sample itself,
+    // and hands them over here as level times cycles, up to a cycle before noise_sample_end().
+    void hold_noise_level(uint64_t cycle, int64_t area, int16_t level) {
+        _noise_area += area;
+        _noise_cycle = cycle;
+        _noise_level = level;
+    }
+
+    uint64_t noise_sample_end() const {
+        return _noise_sample_end;
+    }
+
+    void set_gain(uint8_t side, uint8_t channel, uint64_t cycle, int32_t gain);
+
+    // Appends the samples that are complete by this cycle, as interleaved left/right pairs.
+    void read_samples(uint64_t cycle, std::vector<int16_t>& samples);
+
+    private:
+    // Steps the noise output to the average of every output sample that ended by this cycle.
+    void finish_noise_samples(uint64_t cycle);
+    void set_noise_output(uint64_t cycle, int16_t level);
+};
@@ -12,7 +12,7 @@ class WaveChannel : public SoundChannel {
     public:
     WaveChannel(uint16_t base_address);
 
-    void tick();
+    void advance(uint64_t cycle, uint32_t cycles);
     void div_tick(uint8_t div_apu);
 
     int16_t current_sample();
@@ -23,4 +23,7 @@ class WaveChannel : public SoundChannel {
     void write_io_register(uint16_t address, uint8_t value);
 
     void clear_registers();
+
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include "pixelkernels.h"
+
+constexpr uint16_t TILE_DATA_SIZE = 0x1800; // 0x8000-0x97FF, tilemaps follow
+constexpr uint16_t TILE_COUNT = TILE_DATA_SIZE / 16;
+
+// Tile data decoded to one byte (0-3) per pixel, along with an X-flipped copy for
+// sprites. Tiles are decoded the first time they are drawn, and dropped again when
+// their VRAM is written to.
+class TileCache {
+
+    private:
+    const uint8_t* _vram;
+    const PixelKernels* _kernels = &PixelKernels::best();
+    uint8_t _pixels[TILE_COUNT][2][64]; // Normal and X-flipped, row by row
+    bool _valid[TILE_COUNT] = {};
+
+    public:
+    TileCache(const uint8_t* vram);
+
+    // The 8 pixels of a tile row, tile_offset being where the tile starts in VRAM.
+    const uint8_t* row(uint16_t tile_offset, uint8_t row, bool x_flip = false) {
+        uint16_t tile = tile_offset / 16;
+        if (!_valid[tile]) {
+            decode(tile);
+        }
+        return _pixels[tile][x_flip] + (row * 8);
+    }
+
+    // Called on every write to VRAM.
+    void invalidate(uint16_t vram_offset) {
+        if (vram_offset < TILE_DATA_SIZE) {
+            _valid[vram_offset / 16] = false;
+        }
+    }
+
+    void clear();
+
+    void set_kernels(const PixelKernels& kernels) {
+        _kernels = &kernels;
+    }
+
+    private:
+    void decode(uint16_t tile);
+};
@@ -39,12 +39,16 @@ class Timer : GBComponent {
     public:
     Timer(GBSystem& gb);
 
-    void tick();
+    void sync(uint64_t cycle);
+    void reset_sync_cycle();
     void tick_tima();
 
     uint8_t read_io_register(uint16_t address);
     void write_io_register(uint16_t address, uint8_t value);
 
+    void save_state(StateWriter& state) const;
+    void load_state(StateReader& state);
+
     uint8_t div() const {
         return _div >> 8;
     }
@@ -53,7 +57,15 @@ class Timer : GBComponent {
         return _div;
     }
 
+    // Full DIV value right after the given (already simulated) cycle.
+    uint16_t div_at(uint64_t cycle) const {
+        return _div - (uint16_t) (_sync_cycle - 1 - cycle);
+    }
+
     bool enabled() const {
         return _enabled;
     }
+
+    private:
+    void schedule_overflow();
 };
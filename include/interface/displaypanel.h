@@ -6,7 +6,6 @@
 
 class DisplayPanel : public wxPanel, public wxFileDropTarget {
     wxBitmap* image;
-    wxMutex painting_mutex;
 
     public:
     DisplayPanel(wxFrame* parent);
@@ -1,26 +1,36 @@
 #pragma once
 #include <wx/wxprec.h>
 #include <wx/wx.h>
+#include <wx/timer.h>
 
 namespace CustomMenuIds {
     enum CustomMenuIds {
         ID_PAUSE = 1,
+        ID_AUDIO_LATENCY, // One per AUDIO_LATENCIES_MS entry
     };
 }
 
 class EmulatorFrame : public wxFrame {
     private:
     wxBitmap display;
+    wxTimer stats_timer;
+    uint32_t audio_latency_ms;
 
     public:
     EmulatorFrame(const wxString& title, const wxSize& size);
 
+    uint32_t audio_latency() const {
+        return audio_latency_ms;
+    }
+
     private:
     void on_file_open(wxCommandEvent& event);
     void on_file_close(wxCommandEvent& event);
     void on_file_exit(wxCommandEvent& event);
 
     void on_emulation_pause(wxCommandEvent& event);
+    void on_audio_latency(wxCommandEvent& event);
+    void on_stats_timer(wxTimerEvent& event);
 
     wxDECLARE_EVENT_TABLE();
 };
\ No newline at end of file
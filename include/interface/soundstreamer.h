@@ -4,18 +4,60 @@
 #include <SFML/Audio/Sound.hpp>
 #include <SFML/Audio/SoundBuffer.hpp>
 #include <SFML/System.hpp>
+#include "sound/samplering.h"
+
+// What most output devices run at natively, so the stream doesn't get resampled twice.
+// The APU's band-limited synthesis does the conversion from its own clock.
+constexpr uint32_t SOUND_SAMPLE_RATE = 48000;
+constexpr uint32_t SOUND_DEFAULT_LATENCY_MS = 60;
+constexpr size_t SOUND_MIN_CHUNK_SAMPLES = 128;
+constexpr size_t SOUND_BUFFER_SAMPLES = 32768; // Stereo samples the emulator can get ahead by
+constexpr size_t SOUND_QUEUED_CHUNKS = 3;      // Chunks SFML keeps queued on the device
+constexpr size_t SOUND_SLACK_CHUNKS = 2;       // Chunks kept in the ring on top of a frame's worth
+constexpr double SOUND_FRAME_RATE = 59.7275;   // Samples come in a Game Boy frame at a time
 
 class SoundStreamer : public sf::SoundStream {
-    public:
-    sf::Mutex mutex;
-    std::vector<sf::Int16> filled_audio_buffer;
-    std::vector<sf::Int16> playing_audio_buffer;
 
-    SoundStreamer();
+    SampleRing _samples = SampleRing(SOUND_BUFFER_SAMPLES);
+    std::vector<sf::Int16> _chunk;
+    uint32_t _latency_ms = 0;
+
+    public:
+    SoundStreamer(uint32_t latency_ms = SOUND_DEFAULT_LATENCY_MS);
 
     bool onGetData(SoundStream::Chunk& data);
 
     void onSeek(sf::Time timeOffset);
 
-    void add_sample(sf::Int16 leftSample, sf::Int16 rightSample);
+    // Emulator thread: queues count stereo samples, as left/right pairs.
+    void add_samples(const sf::Int16* samples, size_t count);
+
+    // Sets how far ahead of what the device plays the emulator stays, end to end: a frame's
+    // worth of samples and SOUND_SLACK_CHUNKS chunks in the ring, and SOUND_QUEUED_CHUNKS
+    // more queued in SFML. Chunks are sized to make that add up. Only while stopped, and
+    // drops anything buffered.
+    void set_latency(uint32_t latency_ms);
+
+    uint32_t latency() const {
+        return _latency_ms;
+    }
+
+    // Stereo samples handed to SFML at a time.
+    size_t chunk_samples() const {
+        return _chunk.size() / 2;
+    }
+
+    // Stereo samples to keep in the ring for the latency set, with frames of this many.
+    double target_fill(double frame_samples) const {
+        return frame_samples + (chunk_samples() * SOUND_SLACK_CHUNKS);
+    }
+
+    // Stereo samples waiting to be played. Safe to call from any thread, see SampleRing::fill.
+    size_t buffered() const {
+        return _samples.fill();
+    }
+
+    SampleRingStats stats() const {
+        return _samples.stats();
+    }
 };
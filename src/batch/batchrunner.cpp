@@ -0,0 +1,149 @@
+#include "batchrunner.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+BatchSession::BatchSession(const std::vector<uint8_t>& rom, uint64_t frames) :
+    _gb(new GBSystem(false)),
+    _frame_limit(frames)
+{
+    std::vector<uint8_t> rom_copy = rom;
+    _gb->reset();
+    _gb->cartridge().load_rom(rom_copy);
+
+    const CartridgeHeader& header = _gb->cartridge().header();
+    if (header.calculate_header_checksum() != header.header_checksum) {
+        throw std::invalid_argument("Invalid ROM header checksum");
+    }
+}
+
+void BatchSession::run_frame() {
+    auto input = input_script.find(_gb->frame_number);
+    if (input != input_script.end()) {
+        _gb->joypad().set_inputs(input->second);
+    }
+
+    _gb->run_frame();
+
+    std::vector<int16_t>& samples = _gb->apu().sample_buffer;
+    if (!samples.empty()) {
+        audio.insert(audio.end(), samples.begin(), samples.end());
+        samples.clear();
+    }
+}
+
+BatchRunner::BatchRunner(unsigned threads) :
+    _thread_count(threads)
+{
+    if (_thread_count == 0) {
+        _thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+size_t BatchRunner::add_session(const std::vector<uint8_t>& rom, uint64_t frames) {
+    _sessions.emplace_back(new BatchSession(rom, frames));
+    return _sessions.size() - 1;
+}
+
+void BatchRunner::run() {
+    // Deal the sessions out round-robin, idle workers steal the rest.
+    _queues.clear();
+    for (unsigned i = 0; i < _thread_count; i++) {
+        _queues.emplace_back(new WorkQueue());
+    }
+
+    size_t remaining = 0;
+    for (size_t i = 0; i < _sessions.size(); i++) {
+        if (!_sessions[i]->finished()) {
+            _queues[remaining++ % _thread_count]->sessions.push_back(i);
+        }
+    }
+    _remaining = remaining;
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < _thread_count; i++) {
+        threads.emplace_back(&BatchRunner::worker, this, i);
+    }
+    worker(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void BatchRunner::worker(unsigned index) {
+    size_t session_index;
+    while (_remaining > 0) {
+        uint64_t generation = _work_generation;
+        if (!pop_local(index, session_index) && !steal(index, session_index)) {
+            // Everything left is being run by other workers. Sleep until one of them has
+            // more queued than it takes back itself, or the batch is done.
+            std::unique_lock<std::mutex> lock(_idle_mutex);
+            _idle_workers++;
+            _work_available.wait(lock, [&] { return _work_generation != generation || _remaining == 0; });
+            _idle_workers--;
+            continue;
+        }
+
+        BatchSession& session = *_sessions[session_index];
+        try {
+            for (uint32_t i = 0; i < frames_per_quantum && !session.finished(); i++) {
+                session.run_frame();
+                if (on_frame) {
+                    on_frame(session_index, session);
+                }
+            }
+        } catch (const std::exception& e) {
+            session.error = e.what();
+        }
+
+        if (session.finished()) {
+            if (--_remaining == 0) {
+                std::lock_guard<std::mutex> lock(_idle_mutex);
+                _work_available.notify_all();
+            }
+        } else {
+            // Requeue at the back, so this worker keeps running the same session
+            // while it's still hot in cache. Thieves take from the front.
+            WorkQueue& queue = *_queues[index];
+            size_t queued;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.sessions.push_back(session_index);
+                queued = queue.sessions.size();
+            }
+            if (queued > 1) {
+                // Only wake a worker for the sessions this one won't get to next
+                _work_generation++;
+                if (_idle_workers > 0) {
+                    std::lock_guard<std::mutex> lock(_idle_mutex);
+                    _work_available.notify_one();
+                }
+            }
+        }
+    }
+}
+
+bool BatchRunner::pop_local(unsigned worker, size_t& session) {
+    WorkQueue& queue = *_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.sessions.empty()) {
+        return false;
+    }
+    session = queue.sessions.back();
+    queue.sessions.pop_back();
+    return true;
+}
+
+bool BatchRunner::steal(unsigned worker, size_t& session) {
+    for (unsigned i = 1; i < _thread_count; i++) {
+        WorkQueue& queue = *_queues[(worker + i) % _thread_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.sessions.empty()) {
+            session = queue.sessions.front();
+            queue.sessions.pop_front();
+            _steals++;
+            return true;
+        }
+    }
+    return false;
+}
\ No newline at end of file
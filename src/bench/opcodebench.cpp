@@ -0,0 +1,173 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "scgbe.h"
+
+// Times every opcode through the handler tables and through the reference switch.
+// Each opcode is placed at 0x150 of a blank ROM and executed over and over, resetting
+// PC, SP and the pointer registers in between so jumps, calls and memory accesses stay in the same place.
+// Before timing, runs each opcode through both from the same random register, flag and WRAM
+// contents, and checks they leave the whole system in the same state.
+
+constexpr uint16_t CODE_ADDRESS = 0x150;
+constexpr int CHECK_STATES = 64;
+constexpr uint8_t INVALID_OPCODES[] = { 0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD };
+
+static std::vector<uint8_t> make_rom(bool cb, uint8_t opcode) {
+    std::vector<uint8_t> rom(0x8000, 0x00);
+    rom[0x147] = 0x00; // ROM only
+    rom[0x148] = 0x00; // 32 KB
+    rom[0x149] = 0x00; // No SRAM
+
+    uint8_t checksum = 0;
+    for (int i = 0x134; i <= 0x14C; i++) {
+        checksum = checksum - rom[i] - 1;
+    }
+    rom[0x14D] = checksum;
+
+    // Immediates point into WRAM (0xC2xx), 8 bit ones are 0
+    uint16_t addr = CODE_ADDRESS;
+    if (cb) {
+        rom[addr++] = 0xCB;
+    }
+    rom[addr++] = opcode;
+    rom[addr++] = 0x00;
+    rom[addr++] = 0xC2;
+    return rom;
+}
+
+static uint32_t next_random(uint32_t& seed) {
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+static void load_check_state(GBSystem& gb, uint32_t seed) {
+    // WRAM first, it's what the pointer registers and immediates point into
+    uint32_t wram_seed = seed;
+    for (uint16_t address = 0xC000; address < 0xE000; address++) {
+        gb.write_address(address, (uint8_t) next_random(wram_seed));
+    }
+
+    Registers& registers = gb.cpu().registers;
+    registers.a = (uint8_t) next_random(seed);
+    registers.set_f((uint8_t) next_random(seed) & 0xF0);
+    registers.set_bc(0xC000 | (next_random(seed) & 0x1FFF));
+    registers.set_de(0xC000 | (next_random(seed) & 0x1FFF));
+    registers.set_hl(0xC000 | (next_random(seed) & 0x1FFF));
+    registers.sp = 0xC100 | (next_random(seed) & 0x1DFF);
+    registers.pc = CODE_ADDRESS + 1;
+}
+
+// Returns the number of states the two disagreed on.
+static int check_opcode(GBSystem& table_gb, GBSystem& reference_gb, uint8_t opcode) {
+    int mismatches = 0;
+    std::vector<uint8_t> table_state;
+    std::vector<uint8_t> reference_state;
+    for (int i = 0; i < CHECK_STATES; i++) {
+        uint32_t seed = ((uint32_t) opcode << 16) | i;
+        load_check_state(table_gb, seed);
+        load_check_state(reference_gb, seed);
+
+        uint8_t table_cycles = table_gb.cpu().execute_opcode(opcode);
+        uint8_t reference_cycles = reference_gb.cpu().execute_reference(opcode);
+        table_gb.save_state(table_state);
+        reference_gb.save_state(reference_state);
+        if (table_cycles != reference_cycles || table_state != reference_state) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static double time_opcode(GBSystem& gb, bool reference, uint8_t opcode, uint32_t iterations) {
+    CPU& cpu = gb.cpu();
+    uint8_t cycles = 0;
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        cpu.registers.pc = CODE_ADDRESS + 1; // Just past the opcode, as after a fetch
+        cpu.registers.sp = 0xDFF0;
+        cpu.registers.set_bc(0xC100);
+        cpu.registers.set_de(0xC100);
+        cpu.registers.set_hl(0xC100);
+        cycles += reference ? cpu.execute_reference(opcode) : cpu.execute_opcode(opcode);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    // Keep the results alive
+    volatile uint8_t sink = cycles;
+    (void) sink;
+    return elapsed.count() / iterations;
+}
+
+static bool is_invalid(uint8_t opcode) {
+    for (uint8_t invalid : INVALID_OPCODES) {
+        if (opcode == invalid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = 200000;
+    if (argc > 1) {
+        iterations = std::stoul(argv[1]);
+    }
+
+    std::unique_ptr<GBSystem> gb(new GBSystem(false));
+    std::unique_ptr<GBSystem> reference_gb(new GBSystem(false));
+    int mismatched_opcodes = 0;
+    double total_table = 0;
+    double total_reference = 0;
+    int count = 0;
+
+    std::cout << "opcode   table ns   switch ns   speedup" << std::endl;
+    for (int prefix = 0; prefix < 2; prefix++) {
+        bool cb = prefix == 1;
+        for (int i = 0; i < 256; i++) {
+            uint8_t opcode = i;
+            if (!cb && (opcode == 0xCB || is_invalid(opcode))) {
+                continue;
+            }
+
+            std::vector<uint8_t> rom = make_rom(cb, opcode);
+            gb->reset();
+            gb->cartridge().load_rom(rom);
+            reference_gb->reset();
+            reference_gb->cartridge().load_rom(rom);
+
+            // The CB prefix is dispatched like any other opcode, its operand follows at PC
+            uint8_t first_opcode = cb ? 0xCB : opcode;
+            int mismatches = check_opcode(*gb, *reference_gb, first_opcode);
+            if (mismatches) {
+                std::cerr << (cb ? "CB " : "") << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << i
+                          << std::dec << std::setfill(' ') << ": tables and switch disagree on " << mismatches
+                          << " of " << CHECK_STATES << " states" << std::endl;
+                mismatched_opcodes++;
+            }
+            double table = time_opcode(*gb, false, first_opcode, iterations);
+            double reference = time_opcode(*gb, true, first_opcode, iterations);
+            total_table += table;
+            total_reference += reference;
+            count++;
+
+            std::cout << (cb ? "CB " : "   ") << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << i
+                      << std::dec << std::fixed << std::setfill(' ') << std::setprecision(2)
+                      << std::setw(11) << table << std::setw(12) << reference
+                      << std::setw(9) << (reference / table) << "x" << std::endl;
+        }
+    }
+
+    std::cout << "mean  " << std::setw(11) << (total_table / count) << std::setw(12) << (total_reference / count)
+              << std::setw(9) << (total_reference / total_table) << "x" << std::endl;
+
+    if (mismatched_opcodes) {
+        std::cerr << mismatched_opcodes << " opcodes ran differently through the tables" << std::endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "pixelkernels.h"
+#include "ppu.h"
+
+// Times drawing a 160 pixel line with 10 sprites on it, from raw 2bpp tile data, the way
+// the PPU used to: a get_pixel_of_tile call per background and sprite pixel. Then does the
+// same with each version of the pixel kernels, decoding whole tile rows and compositing
+// the sprite row over the background, and checks they all draw the same line. Last, times
+// converting a whole frame of shades to packed RGBA and RGB565 pixels.
+
+constexpr int TILES_PER_LINE = SCREEN_W / 8 + 1;
+constexpr int SPRITES = MAX_SPRITES_PER_SCANLINE;
+
+struct Scene {
+    uint8_t tile_data[256 * 16];
+    uint8_t tilemap[32];
+    OAMEntry sprites[SPRITES];
+    uint8_t scroll_x;
+    uint8_t row;
+    uint8_t bg_palette[4];
+    uint8_t obj_palettes[2][4];
+};
+
+static uint8_t get_pixel_of_tile(const uint8_t* tile_data, uint8_t tile, uint8_t x, uint8_t y) {
+    const uint8_t* data = tile_data + (tile * 16) + (y * 2);
+    uint8_t tile_pixel_mask = 1 << (7 - x);
+    return ((data[1] & tile_pixel_mask) != 0) << 1 | ((data[0] & tile_pixel_mask) != 0);
+}
+
+static void draw_per_pixel(const Scene& scene, uint8_t* line) {
+    for (int x = 0; x < SCREEN_W; x++) {
+        const OAMEntry* drew_sprite = nullptr;
+        for (const OAMEntry& sprite : scene.sprites) {
+            uint8_t x_diff = (x + 8) - sprite.x_position;
+            if (x_diff >= 8) {
+                continue;
+            }
+            uint8_t pixel_x = sprite.x_flip() ? 7 - x_diff : x_diff;
+            uint8_t value = get_pixel_of_tile(scene.tile_data, sprite.tile_index, pixel_x, scene.row);
+            if (value != 0) {
+                line[x] = scene.obj_palettes[sprite.dmg_palette()][value];
+                drew_sprite = &sprite;
+                break;
+            }
+        }
+
+        uint8_t bg_x = x + scene.scroll_x;
+        uint8_t value = get_pixel_of_tile(scene.tile_data, scene.tilemap[bg_x / 8], bg_x % 8, scene.row);
+        if (!drew_sprite || (drew_sprite->priority() && value != 0)) {
+            line[x] = scene.bg_palette[value];
+        }
+    }
+}
+
+static void draw_with_kernels(const PixelKernels& kernels, const Scene& scene, uint8_t* line) {
+    uint8_t bg[TILES_PER_LINE * 8];
+    uint8_t first_tile = scene.scroll_x / 8;
+    for (int i = 0; i < TILES_PER_LINE; i++) {
+        const uint8_t* data = scene.tile_data + (scene.tilemap[(first_tile + i) % 32] * 16) + (scene.row * 2);
+        kernels.decode_row(data[0], data[1], bg + (i * 8));
+    }
+
+    uint8_t sprite_row[SCREEN_W] = {};
+    for (const OAMEntry& sprite : scene.sprites) {
+        const uint8_t* data = scene.tile_data + (sprite.tile_index * 16) + (scene.row * 2);
+        uint8_t pixels[8];
+        kernels.decode_row(data[0], data[1], pixels);
+        uint8_t flags = SPRITE_PIXEL_OPAQUE | (sprite.priority() ? SPRITE_PIXEL_BEHIND_BG : 0);
+        for (int pixel = 0; pixel < 8; pixel++) {
+            int x = sprite.x_position - 8 + pixel;
+            uint8_t value = pixels[sprite.x_flip() ? 7 - pixel : pixel];
+            if (x >= 0 && x < SCREEN_W && !sprite_row[x] && value) {
+                sprite_row[x] = flags | scene.obj_palettes[sprite.dmg_palette()][value];
+            }
+        }
+    }
+
+    kernels.composite(bg + (scene.scroll_x % 8), sprite_row, scene.bg_palette, line, SCREEN_W);
+}
+
+template <typename Draw>
+static double time_lines(const Scene* scenes, size_t scene_count, uint32_t iterations, uint8_t* line, Draw draw) {
+    auto start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        draw(scenes[i % scene_count], line);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    volatile uint8_t sink = line[SCREEN_W / 2];
+    (void) sink;
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = 200000;
+    if (argc > 1) {
+        iterations = std::stoul(argv[1]);
+    }
+
+    std::mt19937 random(1);
+    constexpr size_t SCENE_COUNT = 64;
+    std::unique_ptr<Scene[]> scenes(new Scene[SCENE_COUNT]);
+    for (size_t i = 0; i < SCENE_COUNT; i++) {
+        Scene& scene = scenes[i];
+        for (uint8_t& byte : scene.tile_data) {
+            byte = random();
+        }
+        for (uint8_t& tile : scene.tilemap) {
+            tile = random();
+        }
+        for (OAMEntry& sprite : scene.sprites) {
+            sprite = { 0, (uint8_t) (random() % 176), (uint8_t) random(), (uint8_t) (random() & 0b10110000) };
+        }
+        scene.scroll_x = random();
+        scene.row = random() % 8;
+        for (int color = 0; color < 4; color++) {
+            scene.bg_palette[color] = random() % 4;
+            scene.obj_palettes[0][color] = random() % 4;
+            scene.obj_palettes[1][color] = random() % 4;
+        }
+    }
+
+    uint8_t expected[SCREEN_W];
+    uint8_t line[SCREEN_W];
+    double per_pixel = time_lines(scenes.get(), SCENE_COUNT, iterations, line, draw_per_pixel);
+
+    std::cout << "version      ns/line   speedup" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << std::left << std::setw(10) << "per pixel" << std::right << std::setw(10) << per_pixel << std::endl;
+
+    int mismatches = 0;
+    for (const PixelKernels* kernels : PixelKernels::available()) {
+        for (size_t i = 0; i < SCENE_COUNT; i++) {
+            draw_per_pixel(scenes[i], expected);
+            draw_with_kernels(*kernels, scenes[i], line);
+            if (std::memcmp(expected, line, SCREEN_W) != 0) {
+                mismatches++;
+            }
+        }
+
+        double nanoseconds = time_lines(scenes.get(), SCENE_COUNT, iterations, line, [kernels](const Scene& scene, uint8_t* out) {
+            draw_with_kernels(*kernels, scene, out);
+        });
+        std::cout << std::left << std::setw(10) << kernels->name << std::right << std::setw(10) << nanoseconds
+                  << std::setw(9) << std::setprecision(2) << (per_pixel / nanoseconds) << "x" << std::setprecision(1) << std::endl;
+    }
+
+    std::vector<uint8_t> shades(SCREEN_W * SCREEN_H);
+    for (uint8_t& shade : shades) {
+        shade = random() % 4;
+    }
+    const uint32_t lut32[4] = { 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000 };
+    const uint16_t lut16[4] = { 0xFFFF, 0xAD55, 0x52AA, 0x0000 };
+    std::vector<uint32_t> expected32(shades.size()), rgba32(shades.size());
+    std::vector<uint16_t> expected16(shades.size()), rgb565(shades.size());
+    PixelKernels::scalar().map_rgba32(shades.data(), lut32, expected32.data(), shades.size());
+    PixelKernels::scalar().map_rgb565(shades.data(), lut16, expected16.data(), shades.size());
+
+    uint32_t frame_iterations = std::max<uint32_t>(1, iterations / 100);
+    std::cout << std::endl << "version   rgba32 ns/frame  rgb565 ns/frame" << std::endl;
+    for (const PixelKernels* kernels : PixelKernels::available()) {
+        auto start_time = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frame_iterations; i++) {
+            kernels->map_rgba32(shades.data(), lut32, rgba32.data(), shades.size());
+        }
+        std::chrono::duration<double, std::nano> rgba32_time = std::chrono::steady_clock::now() - start_time;
+
+        start_time = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frame_iterations; i++) {
+            kernels->map_rgb565(shades.data(), lut16, rgb565.data(), shades.size());
+        }
+        std::chrono::duration<double, std::nano> rgb565_time = std::chrono::steady_clock::now() - start_time;
+
+        std::cout << std::left << std::setw(10) << kernels->name << std::right
+                  << std::setw(15) << (rgba32_time.count() / frame_iterations)
+                  << std::setw(17) << (rgb565_time.count() / frame_iterations) << std::endl;
+        if (rgba32 != expected32 || rgb565 != expected16) {
+            mismatches++;
+        }
+    }
+
+    if (mismatches) {
+        std::cerr << mismatches << " lines or frames were drawn differently" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -4,14 +4,35 @@
 
 constexpr double MAX_AUDIO_ERROR_CORRECT_PERCENTAGE = 0.005;
 
+constexpr uint32_t SCREEN_RGB_COLORS[4] = { 0x62680D, 0x486135, 0x2E473B, 0x21342E };
+
 extern void on_frame_complete();
 
+// The PPU writes a 0xRRGGBB color as R, G, B bytes. Shuffled to match FRAME_NATIVE_LAYOUT.
+static uint32_t frame_color(uint32_t color) {
+    if (!FRAME_NATIVE_LAYOUT) {
+        return color;
+    }
+    uint8_t bytes[4] = {};
+    bytes[wxAlphaPixelFormat::RED] = color >> 16;
+    bytes[wxAlphaPixelFormat::GREEN] = color >> 8;
+    bytes[wxAlphaPixelFormat::BLUE] = color;
+    return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+}
+
 EmulatorThread::EmulatorThread(std::vector<uint8_t>& rom)
-    : wxThread(wxTHREAD_DETACHED)
+    : wxThread(wxTHREAD_DETACHED), _sound_rate(MAX_AUDIO_ERROR_CORRECT_PERCENTAGE)
 {
     _gb = std::unique_ptr<GBSystem>(new GBSystem(false));
 
     _gb->reset();
+    _gb->ppu().set_output_format(OutputFormat::RGBA8888);
+    uint32_t colors[4];
+    for (int shade = 0; shade < 4; shade++) {
+        colors[shade] = frame_color(SCREEN_RGB_COLORS[shade]);
+    }
+    _gb->ppu().set_output_palette(colors);
+    _gb->ppu().set_frame_exchange(&_frames);
     Cartridge& cartridge = _gb->cartridge();
     cartridge.load_rom(rom);
 
@@ -31,30 +52,44 @@ wxThread::ExitCode EmulatorThread::Entry() {
             return (wxThread::ExitCode) 0;
         }
 
-        // Audio sampling rates
-        double sample_rate = 132.0 * (_fps / 59.7275);
-
-        // Tick the emulator
-        bool frame_complete = _gb->tick();
-
-        // Get a new sound sample. (if ready)
-        if (++_audio_sample_timer >= sample_rate) {
-            _sound_stream.add_sample(_gb->apu().current_sample(false), _gb->apu().current_sample(true));
-            _audio_sample_timer -= sample_rate;
+        uint32_t latency_ms = _audio_latency_ms.load(std::memory_order_relaxed);
+        if (latency_ms != _sound_stream.latency()) {
+            _sound_stream.stop();
+            _sound_stream.set_latency(latency_ms);
         }
 
-        if (frame_complete) {
-            on_frame_complete();
-            // Frame is done! Wait enough time...
-            if (_sound_stream.getStatus() != sf::SoundSource::Status::Playing && _sound_stream.filled_audio_buffer.size() >= (1064 * 2)) {
+        // Emulated cycles per sample at the device's rate, nudged to keep the buffer steady
+        double cycles_per_second = _gb->clock_speed * (_fps / 59.7275);
+        _gb->apu().set_sample_interval(cycles_per_second / (SOUND_SAMPLE_RATE * sound_rate_factor()));
+
+        // Run the emulator for a frame
+        _gb->run_frame();
+
+        // Hand the frame's sound samples over to the stream in one go
+        std::vector<int16_t>& samples = _gb->apu().sample_buffer;
+        _sound_stream.add_samples(samples.data(), samples.size() / 2);
+        samples.clear();
+
+        on_frame_complete();
+
+        // Keep a frame's worth of samples buffered, plus some slack for the device's reads
+        // not lining up with our writes. Starting takes the chunks SFML queues up first.
+        double target = _sound_stream.target_fill(SOUND_SAMPLE_RATE / _fps);
+        if (_sound_stream.getStatus() == sf::SoundSource::Status::Playing) {
+            _sound_rate_factor.store(_sound_rate.update(_sound_stream.buffered(), target), std::memory_order_relaxed);
+        } else {
+            _sound_rate.reset();
+            _sound_rate_factor.store(1.0, std::memory_order_relaxed);
+            if (_sound_stream.buffered() >= target + (_sound_stream.chunk_samples() * SOUND_QUEUED_CHUNKS)) {
                 _sound_stream.play();
             }
+        }
 
-            std::this_thread::sleep_until(_emulation_start_time + (frames{_gb->frame_number} * (59.7275 / _fps)));
+        // Frame is done! Wait enough time...
+        std::this_thread::sleep_until(_emulation_start_time + (frames{_gb->frame_number} * (59.7275 / _fps)));
 
-            while (!TestDestroy() && _gb->frame_number >= _pause_after_frame) {
-                std::this_thread::sleep_for(frames{1});
-            }
+        while (!TestDestroy() && _gb->frame_number >= _pause_after_frame) {
+            std::this_thread::sleep_for(frames{1});
         }
     }
 
@@ -67,6 +102,10 @@ void EmulatorThread::set_fps(double fps) {
     _emulation_start_time = std::chrono::system_clock::now();
 }
 
+void EmulatorThread::set_audio_latency(uint32_t latency_ms) {
+    _audio_latency_ms.store(latency_ms, std::memory_order_relaxed);
+}
+
 void EmulatorThread::pause() {
     _pause_after_frame = 0;
     _sound_stream.stop();
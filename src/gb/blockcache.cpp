@@ -0,0 +1,114 @@
+#include "blockcache.h"
+#include "gbsystem.h"
+
+// Recognizes a loop that only reads one memory location and branches back on it:
+//   LD A,(n/nn/rr) or BIT b,(HL); up to two of CP/AND/OR/XOR n, AND A, OR A, BIT b,A; JR/JP cc,start
+// Every iteration leaves the CPU in the same state as the one before it, as long as the
+// value read doesn't change. XOR n is only allowed after a load into A: unlike AND and OR,
+// doing it again changes A, so A has to be reloaded every time. Returns the cycles of an iteration, 0 if it's not such a loop.
+static uint8_t polling_loop_cycles(const std::vector<DecodedInstruction>& block, uint16_t address) {
+    if (block.size() < 2 || block.size() > 4) {
+        return 0;
+    }
+
+    const uint8_t* load = block.front().code;
+    bool loads_a = load[0] == 0xF0 || load[0] == 0xFA || load[0] == 0x7E || load[0] == 0x0A || load[0] == 0x1A;
+    bool reads_memory = loads_a || (load[0] == 0xCB && (load[1] & 0xC7) == 0x46);
+    if (!reads_memory) {
+        return 0;
+    }
+
+    uint8_t cycles = 0;
+    for (size_t i = 0; i + 1 < block.size(); i++) {
+        const uint8_t* code = block[i].code;
+        bool flags_only = code[0] == 0xFE || code[0] == 0xE6 || code[0] == 0xF6 || (code[0] == 0xEE && loads_a)
+            || code[0] == 0xA7 || code[0] == 0xB7 || (code[0] == 0xCB && (code[1] & 0xC7) == 0x47);
+        if (i > 0 && !flags_only) {
+            return 0;
+        }
+        cycles += block[i].cycles;
+    }
+
+    // The branch back costs one more cycle than the decoded, not taken one
+    const DecodedInstruction& branch = block.back();
+    uint8_t opcode = branch.code[0];
+    uint16_t branch_address = address + (branch.code - load);
+    if ((opcode & 0xE7) == 0x20) {
+        if ((uint16_t) (branch_address + 2 + (int8_t) branch.operands[0]) != address) {
+            return 0;
+        }
+    } else if ((opcode & 0xE7) == 0xC2) {
+        if ((((uint16_t) branch.operands[1] << 8) | branch.operands[0]) != address) {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+    return cycles + branch.cycles + 1;
+}
+
+BlockCache::BlockCache(GBSystem& gb_param) :
+    gb(gb_param)
+{}
+
+const DecodedInstruction* BlockCache::lookup(uint16_t address, const uint8_t* code) {
+    std::unique_ptr<CodePage>& page = _pages[page_key(address, code)];
+    if (!page) {
+        page.reset(new CodePage());
+        gb.protect_code(address);
+    }
+
+    std::vector<DecodedInstruction>& block = page->blocks[address & 0xFF];
+    if (!block.empty()) {
+        return block.data();
+    }
+
+    // Decode up to the next jump, or until an instruction would leave the page
+    size_t page_remaining = 0x100 - (address & 0xFF);
+    size_t offset = 0;
+    while (block.size() < MAX_BLOCK_LENGTH) {
+        uint8_t opcode = code[offset];
+        if (offset + CPU::instruction_length(opcode) > page_remaining) {
+            break;
+        }
+
+        DecodedInstruction instruction;
+        CPU::decode(code + offset, instruction);
+        block.push_back(instruction);
+        offset += instruction.length;
+
+        if (CPU::ends_block(opcode)) {
+            break;
+        }
+    }
+
+    if (block.empty()) {
+        return nullptr;
+    }
+    block.front().idle_loop_cycles = polling_loop_cycles(block, address);
+    block.push_back(DecodedInstruction { nullptr, nullptr, 0, 0, { 0, 0 }, 0 });
+
+    stats.blocks_built++;
+    _block_count++;
+    return block.data();
+}
+
+void BlockCache::invalidate(uint16_t address, const uint8_t* code) {
+    auto page = _pages.find(page_key(address, code));
+    if (page != _pages.end()) {
+        for (const std::vector<DecodedInstruction>& block : page->second->blocks) {
+            if (!block.empty()) {
+                stats.invalidations++;
+                _block_count--;
+            }
+        }
+        _pages.erase(page);
+    }
+    _next = nullptr;
+}
+
+void BlockCache::clear() {
+    _pages.clear();
+    _block_count = 0;
+    _next = nullptr;
+}
\ No newline at end of file
@@ -1,17 +1,30 @@
 #include "cartridge.h"
+#include <algorithm>
+#include <cstring>
 #include <ctime>
+#include "gbsystem.h"
 #include "memorymap.h"
 
-extern bool log_on;
+// Backs unmapped ROM banks and disabled SRAM, shared by every cartridge.
+static const uint8_t* open_bus_page() {
+    static const std::vector<uint8_t> page(ROM_SIZE, 0xFF);
+    return page.data();
+}
 
 Cartridge::Cartridge(GBSystem& gb_param) :
     gb(gb_param)
 {
-
+    // Nothing is mapped until a ROM is loaded
+    _rom_banks[0] = open_bus_page();
+    _rom_banks[1] = open_bus_page();
+    _sram_read_bank = open_bus_page();
 }
 
 void Cartridge::load_rom(std::vector<uint8_t>& bytes) {
     _rom = bytes;
+    // Pad to whole banks, so any bank is either entirely present or open bus.
+    size_t bank_count = std::max<size_t>(2, (_rom.size() + ROM_SIZE - 1) / ROM_SIZE);
+    _rom.resize(bank_count * ROM_SIZE, 0xFF);
     _header = (CartridgeHeader*) (_rom.data() + 0x100);
 
     switch (header().cartridge_type) {
@@ -79,62 +92,72 @@ void Cartridge::load_rom(std::vector<uint8_t>& bytes) {
         }
     }
     _sram = std::vector<uint8_t>(sram_bytes);
+    update_banks();
+
+    // Blocks decoded from the previous ROM
+    gb.flush_code_cache();
+    // Code translated ahead of time for this one, if any
+    gb.cpu().recompiled().load_rom(bytes);
 }
 
-uint8_t Cartridge::read_address(uint16_t address) {
+uint32_t Cartridge::rom_address(uint16_t address) const {
     uint32_t target_addr = address;
-    if (address >= ROM_START && address < (ROM_START + (ROM_SIZE * 2))) {
-        // ROM
-        switch (_mbc) {
-        case MBC::MBC1: {
-            uint8_t effective_rom_bank = _rom_bank & (header().rom_size <= 0x03 ? 0xF : 0x1F);
-            if (address >= ROM_START && address < (ROM_START + ROM_SIZE)) {
-                if (_banking_mode) {
-                    // Advanced mode
-                    // Upper 2 bits control the lower rom bank
-                    effective_rom_bank &= 0x60;
-                } else {
-                    effective_rom_bank = 0;
-                }
-            }
-            target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
-            break;
-        }
-        case MBC::MBC2: {
-            uint8_t effective_rom_bank = (_rom_bank == 0) ? 1 : _rom_bank;
-            if (address >= (ROM_START + ROM_SIZE)) {
-                target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
-            }
-            break;
-        }
-        case MBC::MBC3: {
-            uint8_t effective_rom_bank = _rom_bank;
-            if (address >= (ROM_START + ROM_SIZE)) {
-                // If bank == 0, set it to 1.
-                effective_rom_bank |= (_rom_bank == 0);
+    switch (_mbc) {
+    case MBC::MBC1: {
+        uint8_t effective_rom_bank = _rom_bank & (header().rom_size <= 0x03 ? 0xF : 0x1F);
+        if (address >= ROM_START && address < (ROM_START + ROM_SIZE)) {
+            if (_banking_mode) {
+                // Advanced mode
+                // Upper 2 bits control the lower rom bank
+                effective_rom_bank &= 0x60;
             } else {
                 effective_rom_bank = 0;
             }
-
-            target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
-            break;
         }
-        case MBC::MBC5: {
-            uint8_t effective_rom_bank = _rom_bank;
-            if (address < (ROM_START + ROM_SIZE)) {
-                effective_rom_bank = 0;
-            }
+        target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
+        break;
+    }
+    case MBC::MBC2: {
+        uint8_t effective_rom_bank = (_rom_bank == 0) ? 1 : _rom_bank;
+        if (address >= (ROM_START + ROM_SIZE)) {
             target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
-            break;
         }
+        break;
+    }
+    case MBC::MBC3: {
+        uint8_t effective_rom_bank = _rom_bank;
+        if (address >= (ROM_START + ROM_SIZE)) {
+            // If bank == 0, set it to 1.
+            effective_rom_bank |= (_rom_bank == 0);
+        } else {
+            effective_rom_bank = 0;
         }
 
-        if (target_addr >= _rom.size()) {
-            return 0xFF;
+        target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
+        break;
+    }
+    case MBC::MBC5: {
+        uint8_t effective_rom_bank = _rom_bank;
+        if (address < (ROM_START + ROM_SIZE)) {
+            effective_rom_bank = 0;
         }
-        return _rom[target_addr];
+        target_addr = (address % ROM_SIZE) + (((uint32_t) effective_rom_bank) * ROM_SIZE);
+        break;
+    }
+    }
+    return target_addr;
+}
+
+uint8_t Cartridge::read_address(uint16_t address) {
+    uint32_t target_addr = address;
+    if (address >= ROM_START && address < (ROM_START + (ROM_SIZE * 2))) {
+        // ROM
+        return _rom_banks[address / ROM_SIZE][address % ROM_SIZE];
+    } else if (_sram_read_bank) {
+        // SRAM, plain RAM bank
+        return _sram_read_bank[address - SRAM_START];
     } else {
-        // SRAM
+        // SRAM, with special behaviour
         if (!_sram_enabled) {
             return 0xFF;
         }
@@ -211,6 +234,13 @@ uint8_t Cartridge::read_address(uint16_t address) {
 }
 
 void Cartridge::write_address(uint16_t address, uint8_t value) {
+    if (_sram_write_bank && address >= SRAM_START && address < (SRAM_START + SRAM_SIZE)) {
+        _sram_write_bank[address - SRAM_START] = value;
+        return;
+    }
+
+    // The SRAM branches below rebase address, so test it before they do
+    bool register_write = address < (ROM_START + (ROM_SIZE * 2));
 
     switch (_mbc) {
     case MBC::MBC1: {
@@ -417,4 +447,114 @@ void Cartridge::write_address(uint16_t address, uint8_t value) {
         break;
     }
     }
+
+    if (register_write) {
+        // Banking or SRAM enable may have changed
+        update_banks();
+    }
+}
+
+void Cartridge::update_banks() {
+    for (int slot = 0; slot < 2; slot++) {
+        uint32_t bank_addr = rom_address(ROM_START + (slot * ROM_SIZE));
+        _rom_banks[slot] = (bank_addr < _rom.size()) ? _rom.data() + bank_addr : open_bus_page();
+    }
+
+    // SRAM reads, mirroring the address calculation of read_address
+    _sram_read_bank = nullptr;
+    if (!_sram_enabled) {
+        _sram_read_bank = open_bus_page();
+    } else if (_mbc == MBC::MBC1 || _mbc == MBC::MBC5 || (_mbc == MBC::MBC3 && _sram_bank <= 0x03)) {
+        uint32_t bank_addr = 0;
+        if (_mbc != MBC::MBC1 || _banking_mode) {
+            bank_addr = _sram_bank * ROM_SIZE;
+        }
+
+        if (bank_addr >= _sram.size()) {
+            _sram_read_bank = open_bus_page();
+        } else if (bank_addr + SRAM_SIZE <= _sram.size()) {
+            _sram_read_bank = _sram.data() + bank_addr;
+        }
+    }
+
+    // SRAM writes, mirroring write_address. MBC3/5 wrap around, MBC1 ignores out of range writes.
+    _sram_write_bank = nullptr;
+    if (_sram_enabled && !_sram.empty() && (_sram.size() % SRAM_SIZE) == 0) {
+        uint16_t bank_addr = _sram_bank * ROM_SIZE;
+        switch (_mbc) {
+        case MBC::MBC1: {
+            bank_addr = _banking_mode ? bank_addr : 0;
+            if (bank_addr + SRAM_SIZE <= _sram.size()) {
+                _sram_write_bank = _sram.data() + bank_addr;
+            }
+            break;
+        }
+        case MBC::MBC3: {
+            if (_sram_bank <= 0x03) {
+                _sram_write_bank = _sram.data() + (bank_addr % _sram.size());
+            }
+            break;
+        }
+        case MBC::MBC5: {
+            _sram_write_bank = _sram.data() + (bank_addr % _sram.size());
+            break;
+        }
+        default: {
+            break;
+        }
+        }
+    }
+
+    gb.update_memory_map(ROM_START, ROM_START + (ROM_SIZE * 2) - 1);
+    gb.update_memory_map(SRAM_START, SRAM_START + SRAM_SIZE - 1);
+}
+
+const uint8_t* Cartridge::read_page(uint16_t address) const {
+    if (address < (ROM_START + (ROM_SIZE * 2))) {
+        return _rom_banks[address / ROM_SIZE] + (address % ROM_SIZE);
+    }
+    return _sram_read_bank ? _sram_read_bank + (address - SRAM_START) : nullptr;
+}
+
+uint8_t* Cartridge::write_page(uint16_t address) {
+    if (address < (ROM_START + (ROM_SIZE * 2)) || !_sram_write_bank) {
+        return nullptr;
+    }
+    return _sram_write_bank + (address - SRAM_START);
 }
+
+void Cartridge::save_state(StateWriter& state) const {
+    // Used to make sure the state is loaded back into the same game
+    state.write(_header->header_checksum);
+    state.write(_header->global_checksum);
+
+    state.write(_rom_bank);
+    state.write(_banking_mode);
+    state.write((uint32_t) _sram.size());
+    state.write_bytes(_sram.data(), _sram.size());
+    state.write(_sram_enabled);
+    state.write(_sram_bank);
+    state.write(_rtc_latched);
+    state.write(_latched_rtc_value);
+}
+
+void Cartridge::load_state(StateReader& state) {
+    uint8_t header_checksum = state.read<uint8_t>();
+    uint8_t global_checksum[2];
+    state.read(global_checksum);
+    if (header_checksum != _header->header_checksum || std::memcmp(global_checksum, _header->global_checksum, 2) != 0) {
+        throw std::invalid_argument("Save state is for a different ROM");
+    }
+
+    state.read(_rom_bank);
+    state.read(_banking_mode);
+    if (state.read<uint32_t>() != _sram.size()) {
+        throw std::invalid_argument("Save state has a different SRAM size");
+    }
+    state.read_bytes(_sram.data(), _sram.size());
+    state.read(_sram_enabled);
+    state.read(_sram_bank);
+    state.read(_rtc_latched);
+    state.read(_latched_rtc_value);
+    update_banks();
+}
\ No newline at end of file
@@ -2,28 +2,31 @@
 #include <cstring>
 #include <strings.h>
 #include <cstdlib>
+#include <stdexcept>
+#include <string>
 #include "gbsystem.h"
 #include "gbcomponent.h"
 #include "registers.h"
 
 CPU::CPU(GBSystem& gb_param)
-    : GBComponent::GBComponent(gb_param)
+    : GBComponent::GBComponent(gb_param),
+    _block_cache(gb_param),
+    _jit(gb_param, *this),
+    _recompiled(gb_param)
 {
     gb.add_register_callbacks(this, {IF});
 }
 
-void CPU::tick() {
-    if (wait_ticks == 0) {
-        bool ime_enable_was_active = _ime_enable_next_cycle;
+uint8_t CPU::step() {
+    bool ime_enable_was_active = _ime_enable_next_cycle;
 
-        wait_ticks = execute();
+    uint8_t cycles = execute();
 
-        if (ime_enable_was_active && _ime_enable_next_cycle) {
-            _ime_flag = true;
-            _ime_enable_next_cycle = false;
-        }
+    if (ime_enable_was_active && _ime_enable_next_cycle) {
+        _ime_flag = true;
+        _ime_enable_next_cycle = false;
     }
-    wait_ticks--;
+    return cycles;
 }
 
 uint8_t CPU::execute() {
@@ -37,822 +40,614 @@ uint8_t CPU::execute() {
         return 1;
     }
 
+    if (_block_cache.enabled() && !halt_bug) {
+        const uint8_t* code = gb.code_pointer(registers.pc);
+        if (code) {
+            const DecodedInstruction* instruction = _block_cache.fetch(registers.pc, code);
+            if (instruction) {
+                if (instruction->idle_loop_cycles && !_ime_enable_next_cycle && gb.skip_idle_loop(*instruction)) {
+                    return 0;
+                }
+                registers.pc += instruction->length;
+                _operands[0] = instruction->operands[0];
+                _operands[1] = instruction->operands[1];
+                return instruction->handler(*this);
+            }
+        }
+    }
+
     uint8_t opcode = gb.read_address(registers.pc++);
     if (halt_bug) {
         registers.pc--;
         halt_bug = false;
     }
 
-    switch (opcode) {
-    case 0x00: {
-        // NOP: 0b00000000
-        return 1;
-    }
-
-    case 0x01:
-    case 0x11:
-    case 0x21:
-    case 0x31: {
-        // LD WORD REGISTER FROM IMMEDIATE: 0b00xx0001
-        WordRegister::WordRegister target = (WordRegister::WordRegister) ((opcode & 0b00110000) >> 4);
-
-        uint8_t lsb = gb.read_address(registers.pc++);
-        uint8_t msb = gb.read_address(registers.pc++);
-        uint16_t result = (((uint16_t) msb) << 8) + lsb;
+    return execute_opcode(opcode);
+}
 
-        read_cpu_register_word(target, result);
-        return 3;
+template <bool CB, uint8_t OPCODE>
+uint8_t CPU::handle_opcode(CPU& cpu) {
+    if constexpr (CB) {
+        return cpu.cb_instruction<OPCODE>();
+    } else {
+        return cpu.instruction<OPCODE>();
     }
+}
 
-    case 0x02:
-    case 0x12:
-    case 0x22:
-    case 0x32: {
-        // LD TO (INDIRECT) WORD REGISTER FROM A REGISTER: 0b00xx0010
-        WordRegister::WordRegister target;
-        uint16_t auto_increment = 0;
-        switch ((opcode & 0b00110000) >> 4) {
-        case 0: target = WordRegister::BC; break;
-        case 1: target = WordRegister::DE; break;
-        case 2: target = WordRegister::HL; auto_increment = 1; break;
-        case 3: target = WordRegister::HL; auto_increment = -1; break;
-        }
+template <bool CB, size_t... OPCODES>
+constexpr std::array<CPU::OpcodeHandler, sizeof...(OPCODES)> CPU::make_handler_table(std::index_sequence<OPCODES...>) {
+    return {{ &handle_opcode<CB, (uint8_t) OPCODES>... }};
+}
 
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        uint16_t addr = read_cpu_register_word(target);
-        if (auto_increment != 0) {
-            read_cpu_register_word(target, addr + auto_increment);
-        }
-        gb.write_address(addr, value);
-        return 2;
-    }
+// Bytes per instruction, and M-cycles when no branch is taken. The CB prefix is
+// followed by its own opcode, the cost of which is worked out in decode().
+static constexpr uint8_t INSTRUCTION_LENGTHS[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1
+};
+
+static constexpr uint8_t INSTRUCTION_CYCLES[256] = {
+    1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1,
+    1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+    2, 3, 2, 2, 1, 1, 2, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+    2, 3, 2, 2, 3, 3, 3, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 3, 4, 3, 4, 2, 4, 2, 4, 3, 0, 3, 6, 2, 4,
+    2, 3, 3, 1, 3, 4, 2, 4, 2, 4, 3, 1, 3, 1, 2, 4,
+    3, 3, 2, 1, 1, 4, 2, 4, 4, 1, 4, 1, 1, 1, 2, 4,
+    3, 3, 2, 1, 1, 4, 2, 4, 3, 2, 4, 1, 1, 1, 2, 4
+};
+
+uint8_t CPU::execute_opcode(uint8_t opcode) {
+    // Immediates are read up front, every instruction reads them before anything else.
+    for (uint8_t i = 1; i < INSTRUCTION_LENGTHS[opcode]; i++) {
+        _operands[i - 1] = gb.read_address(registers.pc++);
+    }
+    return opcode_handler(opcode)(*this);
+}
 
-    case 0x03:
-    case 0x13:
-    case 0x23:
-    case 0x33: {
-        // INC WORD REGISTER: 0b00xx0011
-        WordRegister::WordRegister target = (WordRegister::WordRegister) ((opcode & 0b00110000) >> 4);
-        uint16_t value = read_cpu_register_word(target) + 1;
-        read_cpu_register_word(target, value);
-        return 2;
-    }
+uint8_t CPU::execute_cb_opcode(uint8_t opcode) {
+    return cb_opcode_handler(opcode)(*this);
+}
 
-    case 0x04:
-    case 0x0C:
-    case 0x14:
-    case 0x1C:
-    case 0x24:
-    case 0x2C:
-    case 0x34:
-    case 0x3C: {
-        // INC BYTE REGISTER: 0b00xxx100
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00111000) >> 3);
-        uint8_t value = read_cpu_register_byte(target);
-        uint8_t result = value + 1;
-
-        registers.flags.zero = result == 0;
-        registers.flags.subtraction = false;
-        registers.flags.half_carry = (value & 0xF) == 0xF;
-        read_cpu_register_byte(target, result);
-        return 1 + ((target == ByteRegister::HL_INDIRECT) * 2);
-    }
+CPU::OpcodeHandler CPU::opcode_handler(uint8_t opcode) {
+    static constexpr std::array<OpcodeHandler, 256> handlers = make_handler_table<false>(std::make_index_sequence<256>());
+    return handlers[opcode];
+}
 
-    case 0x05:
-    case 0x0D:
-    case 0x15:
-    case 0x1D:
-    case 0x25:
-    case 0x2D:
-    case 0x35:
-    case 0x3D: {
-        // DEC BYTE REGISTER: 0b00xxx101
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00111000) >> 3);
-        uint8_t value = read_cpu_register_byte(target);
-        uint8_t result = value - 1;
-
-        registers.flags.zero = result == 0;
-        registers.flags.subtraction = true;
-        registers.flags.half_carry = (value & 0xF) == 0;
-        read_cpu_register_byte(target, result);
-        return 1 + ((target == ByteRegister::HL_INDIRECT) * 2);
-    }
+CPU::OpcodeHandler CPU::cb_opcode_handler(uint8_t opcode) {
+    static constexpr std::array<OpcodeHandler, 256> handlers = make_handler_table<true>(std::make_index_sequence<256>());
+    return handlers[opcode];
+}
 
-    case 0x06:
-    case 0x0E:
-    case 0x16:
-    case 0x1E:
-    case 0x26:
-    case 0x2E:
-    case 0x36:
-    case 0x3E: {
-        // LD TO BYTE REGISTER FROM IMMEDIATE VALUE: 0b00xxx110
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00111000) >> 3);
-        uint8_t value = gb.read_address(registers.pc++);
-        read_cpu_register_byte(target, value);
-        return 2 + (target == ByteRegister::HL_INDIRECT);
+void CPU::decode(const uint8_t* code, DecodedInstruction& instruction) {
+    uint8_t opcode = code[0];
+    instruction.code = code;
+    instruction.length = INSTRUCTION_LENGTHS[opcode];
+    instruction.operands[0] = instruction.length > 1 ? code[1] : 0;
+    instruction.operands[1] = instruction.length > 2 ? code[2] : 0;
+    instruction.idle_loop_cycles = 0;
+
+    if (opcode == 0xCB) {
+        // Skip the prefix handler and go straight to the CB opcode
+        uint8_t cb_opcode = code[1];
+        bool indirect = (cb_opcode & 0b111) == ByteRegister::HL_INDIRECT;
+        bool bit_test = (cb_opcode >> 6) == 1;
+        instruction.handler = cb_opcode_handler(cb_opcode);
+        instruction.cycles = 2 + (indirect * (bit_test ? 1 : 2));
+    } else {
+        instruction.handler = opcode_handler(opcode);
+        instruction.cycles = INSTRUCTION_CYCLES[opcode];
     }
+}
 
-    case 0x07: {
-        // ROTATE LEFT ACCUMULATOR: 0b00000111
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        bool shifted_out_bit = (value & 0b10000000) != 0;
-        value <<= 1;
-        value |= shifted_out_bit;
+uint8_t CPU::instruction_length(uint8_t opcode) {
+    return INSTRUCTION_LENGTHS[opcode];
+}
 
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(false, false, false, shifted_out_bit);
-        return 1;
+bool CPU::valid_opcode(uint8_t opcode) {
+    switch (opcode) {
+    case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+        return false;
+    default:
+        return true;
     }
+}
 
-    case 0x08: {
-        // LD TO WORD (INDIRECT) IMMEDIATE VALUE FROM REGISTER SP: 0b00001000
-        uint8_t addr_lsb = gb.read_address(registers.pc++);
-        uint8_t addr_msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) addr_msb) << 8) + addr_lsb;
-
-        uint8_t sp_lsb = registers.sp & 0xFF;
-        uint8_t sp_msb = (registers.sp >> 8) & 0xFF;
-
-        gb.write_address(addr, sp_lsb);
-        gb.write_address(addr + 1, sp_msb);
-        return 5;
+bool CPU::ends_block(uint8_t opcode) {
+    switch (opcode) {
+    case 0x10: // STOP
+    case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+    case 0x76: // HALT
+    case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xC9: case 0xD9: // RET, RETI
+    case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xC3: case 0xE9: // JP
+    case 0xC4: case 0xCC: case 0xD4: case 0xDC: case 0xCD: // CALL
+    case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+        return true;
+    default:
+        return false;
     }
+}
 
-    case 0x09:
-    case 0x19:
-    case 0x29:
-    case 0x39: {
-        // ADD WORD: 0b00xx1001
-        WordRegister::WordRegister target = (WordRegister::WordRegister) ((opcode & 0b00110000) >> 4);
-        uint16_t current_value = read_cpu_register_word(WordRegister::HL);
-        uint16_t value = read_cpu_register_word(target);
-
-        uint16_t result = current_value + value;
-        read_cpu_register_word(WordRegister::HL, result);
-        registers.flags.subtraction = false;
-        registers.flags.half_carry = ((value & 0xFFF) + (current_value & 0xFFF)) & 0x1000;
-        registers.flags.carry = result < value || result < current_value;
-        return 2;
-    }
+// Opcode bit layout used below: 0bxxyyyzzz, with y = 0bppq.
+template <uint8_t OPCODE>
+uint8_t CPU::instruction() {
+    constexpr uint8_t x = OPCODE >> 6;
+    constexpr uint8_t y = (OPCODE >> 3) & 0b111;
+    constexpr uint8_t z = OPCODE & 0b111;
+    constexpr uint8_t p = y >> 1;
+    constexpr uint8_t q = y & 1;
+    constexpr ByteRegister::ByteRegister reg_y = (ByteRegister::ByteRegister) y;
+    constexpr ByteRegister::ByteRegister reg_z = (ByteRegister::ByteRegister) z;
+    constexpr WordRegister::WordRegister reg_p = (WordRegister::WordRegister) p;
+    constexpr Condition::Condition cc = (Condition::Condition) (y & 0b11);
+    constexpr bool y_indirect = reg_y == ByteRegister::HL_INDIRECT;
+    constexpr bool z_indirect = reg_z == ByteRegister::HL_INDIRECT;
+
+    if constexpr (OPCODE == 0x00) {
+        // NOP
+        return 1;
 
-    case 0x0A:
-    case 0x1A:
-    case 0x2A:
-    case 0x3A: {
-        // LD TO (INDIRECT) WORD REGISTER FROM BYTE REGISTER A : 0b00xx0110
-        WordRegister::WordRegister source;
-        uint16_t auto_increment = 0;
-        switch ((opcode & 0b00110000) >> 4) {
-        case 0: source = WordRegister::BC; break;
-        case 1: source = WordRegister::DE; break;
-        case 2: source = WordRegister::HL; auto_increment = 1; break;
-        case 3: source = WordRegister::HL; auto_increment = -1; break;
-        }
+    } else if constexpr (x == 0 && z == 1 && q == 0) {
+        // LD WORD REGISTER FROM IMMEDIATE
+        set_register_word<reg_p>(immediate_word());
+        return 3;
 
-        uint16_t addr = read_cpu_register_word(source);
-        uint16_t value = gb.read_address(addr);
-        if (auto_increment != 0) {
-            read_cpu_register_word(source, addr + auto_increment);
+    } else if constexpr (x == 0 && z == 2) {
+        // LD (INDIRECT) WORD REGISTER TO/FROM A
+        constexpr WordRegister::WordRegister pointer = (p == 0) ? WordRegister::BC : (p == 1) ? WordRegister::DE : WordRegister::HL;
+        constexpr uint16_t auto_increment = (p == 2) ? 1 : (p == 3) ? -1 : 0;
+        if constexpr (q == 0) {
+            uint8_t value = registers.a;
+            uint16_t addr = get_register_word<pointer>();
+            if constexpr (auto_increment != 0) {
+                set_register_word<pointer>(addr + auto_increment);
+            }
+            gb.write_address(addr, value);
+        } else {
+            uint16_t addr = get_register_word<pointer>();
+            uint8_t value = gb.read_address(addr);
+            if constexpr (auto_increment != 0) {
+                set_register_word<pointer>(addr + auto_increment);
+            }
+            registers.a = value;
         }
-        read_cpu_register_byte(ByteRegister::A, value);
         return 2;
-    }
 
-    case 0x0B:
-    case 0x1B:
-    case 0x2B:
-    case 0x3B: {
-        // DEC WORD REGISTER: 0b00xx1011
-        WordRegister::WordRegister target = (WordRegister::WordRegister) ((opcode & 0b00110000) >> 4);
-        uint16_t value = read_cpu_register_word(target) - 1;
-        read_cpu_register_word(target, value);
+    } else if constexpr (x == 0 && z == 3) {
+        // INC / DEC WORD REGISTER
+        set_register_word<reg_p>(get_register_word<reg_p>() + (q == 0 ? 1 : -1));
         return 2;
-    }
-
-    case 0x0F: {
-        // ROTATE RIGHT ACCUMULATOR: 0b00001111
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        bool shifted_out_bit = (value & 0b00000001) != 0;
-        value >>= 1;
-        value |= (shifted_out_bit << 7);
 
-        read_cpu_register_byte(ByteRegister::A, value);
+    } else if constexpr (x == 0 && z == 4) {
+        // INC BYTE REGISTER
+        set_register_byte<reg_y>(registers.flags.record_inc(get_register_byte<reg_y>()));
+        return 1 + (y_indirect * 2);
+
+    } else if constexpr (x == 0 && z == 5) {
+        // DEC BYTE REGISTER
+        set_register_byte<reg_y>(registers.flags.record_dec(get_register_byte<reg_y>()));
+        return 1 + (y_indirect * 2);
+
+    } else if constexpr (x == 0 && z == 6) {
+        // LD TO BYTE REGISTER FROM IMMEDIATE VALUE
+        set_register_byte<reg_y>(_operands[0]);
+        return 2 + y_indirect;
+
+    } else if constexpr (OPCODE == 0x07 || OPCODE == 0x0F || OPCODE == 0x17 || OPCODE == 0x1F) {
+        // ROTATE ACCUMULATOR (RLCA, RRCA, RLA, RRA)
+        bool shifted_out_bit;
+        registers.a = rotate_shift<y>(registers.a, shifted_out_bit);
         set_all_flags(false, false, false, shifted_out_bit);
         return 1;
-    }
 
-    case 0x10: {
-        // STOP: 0b00010000
-        // TODO
-        // throw std::runtime_error("Stop!");
-        gb.write_address(DIV, 0, true);
-        return 1;
-    }
+    } else if constexpr (OPCODE == 0x08) {
+        // LD TO WORD (INDIRECT) IMMEDIATE VALUE FROM REGISTER SP
+        uint16_t addr = immediate_word();
+        gb.write_address(addr, registers.sp & 0xFF);
+        gb.write_address(addr + 1, (registers.sp >> 8) & 0xFF);
+        return 5;
 
-    case 0x17: {
-        // ROTATE LEFT ACCUMULATOR (THROUGH CARRY): 0b00010111
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        bool shifted_out_bit = (value & 0b10000000) != 0;
-        value <<= 1;
-        value |= registers.flags.carry;
+    } else if constexpr (x == 0 && z == 1 && q == 1) {
+        // ADD WORD
+        uint16_t current_value = registers.hl();
+        uint16_t value = get_register_word<reg_p>();
 
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(false, false, false, shifted_out_bit);
+        uint16_t result = current_value + value;
+        registers.set_hl(result);
+        bool half_carry = ((value & 0xFFF) + (current_value & 0xFFF)) & 0x1000;
+        bool carry = result < value || result < current_value;
+        set_all_flags(registers.flags.zero(), false, half_carry, carry);
+        return 2;
+
+    } else if constexpr (OPCODE == 0x10) {
+        // STOP
+        // TODO
+        gb.write_address(DIV, 0, true);
         return 1;
-    }
 
-    case 0x18: {
-        // RELATIVE JUMP: 0b00011000
-        int8_t offset = (int8_t) gb.read_address(registers.pc++);
+    } else if constexpr (OPCODE == 0x18) {
+        // RELATIVE JUMP
+        int8_t offset = (int8_t) _operands[0];
         registers.pc += offset;
         return 3;
-    }
-
-    case 0x1F: {
-        // ROTATE RIGHT ACCUMULATOR (THROUGH CARRY): 0b00011111
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        bool shifted_out_bit = (value & 0b00000001) != 0;
-        value >>= 1;
-        value |= (registers.flags.carry << 7);
-
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(false, false, false, shifted_out_bit);
-        return 1;
-    }
 
-    case 0x20:
-    case 0x28:
-    case 0x30:
-    case 0x38: {
-        // RELATIVE JUMP (CONDITIONAL): 0b001xx000
-        Condition::Condition cc = (Condition::Condition) ((opcode & 0b00011000) >> 3);
-        int8_t offset = (int8_t) gb.read_address(registers.pc++);
-
-        if (evaluate_condition(cc)) {
+    } else if constexpr (x == 0 && z == 0 && y >= 4) {
+        // RELATIVE JUMP (CONDITIONAL)
+        int8_t offset = (int8_t) _operands[0];
+        if (check_condition<cc>()) {
             registers.pc += offset;
             return 3;
         }
-
         return 2;
-    }
 
-    case 0x27: {
-        // DECIMAL ADJUST ACCUMULATOR: 0b00100111
+    } else if constexpr (OPCODE == 0x27) {
+        // DECIMAL ADJUST ACCUMULATOR
         // Source: https://forums.nesdev.org/viewtopic.php?t=15944
-        uint16_t value = read_cpu_register_byte(ByteRegister::A);
+        uint16_t value = registers.a;
+        bool subtraction = registers.flags.subtraction();
+        bool half_carry = registers.flags.half_carry();
+        bool carry = registers.flags.carry();
 
-        if (!registers.flags.subtraction) {
-            if (registers.flags.half_carry || (value & 0x0F) > 0x09) {
+        if (!subtraction) {
+            if (half_carry || (value & 0x0F) > 0x09) {
                 value += 0x06;
             }
-            if (registers.flags.carry || value > 0x9F) {
+            if (carry || value > 0x9F) {
                 value += 0x60;
             }
         } else {
-            if (registers.flags.half_carry) {
+            if (half_carry) {
                 value -= 0x06;
-                if (!registers.flags.carry) {
+                if (!carry) {
                     value &= 0xFF;
                 }
             }
-            if (registers.flags.carry) {
+            if (carry) {
                 value -= 0x60;
             }
         }
 
-        registers.flags.zero = !(value & 0xFF);
-        registers.flags.carry |= (value > 0xFF);
-        registers.flags.half_carry = false;
-        read_cpu_register_byte(ByteRegister::A, value);
-        return 1;
-    }
-
-    case 0x2F: {
-        // COMPLEMENT ACCUMULATOR: 0b00111111
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        read_cpu_register_byte(ByteRegister::A, ~value);
-
-        registers.flags.subtraction = true;
-        registers.flags.half_carry = true;
+        set_all_flags(!(value & 0xFF), subtraction, false, carry || value > 0xFF);
+        registers.a = value;
         return 1;
-    }
 
-    case 0x37: {
-        // SET CARRY FLAG: 0b00110111
-        registers.flags.subtraction = false;
-        registers.flags.half_carry = false;
-        registers.flags.carry = true;
+    } else if constexpr (OPCODE == 0x2F) {
+        // COMPLEMENT ACCUMULATOR
+        registers.a = ~registers.a;
+        set_all_flags(registers.flags.zero(), true, true, registers.flags.carry());
         return 1;
-    }
 
-    case 0x3F: {
-        // COMPLEMENT CARRY FLAG: 0b00111111
-        registers.flags.subtraction = false;
-        registers.flags.half_carry = false;
-        registers.flags.carry = !registers.flags.carry;
+    } else if constexpr (OPCODE == 0x37 || OPCODE == 0x3F) {
+        // SET / COMPLEMENT CARRY FLAG
+        set_all_flags(registers.flags.zero(), false, false, (OPCODE == 0x37) ? true : !registers.flags.carry());
         return 1;
-    }
 
-    case 0x40 ... 0x75:
-    case 0x77 ... 0x7F: {
-        // LOAD BYTE REGISTER FROM BYTE REGISTER: 0b01xxxyyy
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00111000) >> 3);
-        ByteRegister::ByteRegister source = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        uint8_t value = read_cpu_register_byte(source);
-        read_cpu_register_byte(target, value);
-        return 1 + (source == ByteRegister::HL_INDIRECT || target == ByteRegister::HL_INDIRECT);
-    }
-
-    case 0x76: {
-        // HALT: 0b01110110
+    } else if constexpr (OPCODE == 0x76) {
+        // HALT
         _halted = true;
 
         // Halt bug
-        if (!_ime_flag && (gb.read_address(IE, true) & _interrupt_flags)) {
+        if (!_ime_flag && _pending_interrupts) {
             _halted = _ime_enable_next_cycle;
             halt_bug = true;
         }
         return 1;
-    }
 
-    case 0x80 ... 0x8F: {
-        // ADD: 0b1000cxxx (c = use carry)
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        bool use_carry = (opcode & 0b00001000) != 0;
-        uint8_t value = read_cpu_register_byte(target);
-        uint8_t result = add_byte_with_overflow(value, use_carry);
-        read_cpu_register_byte(ByteRegister::A, result);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
-
-    case 0x90 ... 0x9F: {
-        // SUBTRACT: 0b1001cxxx (c = use carry)
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        bool use_carry = (opcode & 0b00001000) != 0;
-        uint8_t value = read_cpu_register_byte(target);
-        uint8_t result = sub_byte_with_overflow(value, use_carry);
-        read_cpu_register_byte(ByteRegister::A, result);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
+    } else if constexpr (x == 1) {
+        // LOAD BYTE REGISTER FROM BYTE REGISTER
+        set_register_byte<reg_y>(get_register_byte<reg_z>());
+        return 1 + (z_indirect || y_indirect);
 
-    case 0xA0 ... 0xA7: {
-        // AND: 0b10100xxx
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        uint8_t value = read_cpu_register_byte(ByteRegister::A) & read_cpu_register_byte(target);
+    } else if constexpr (x == 2) {
+        // ALU OPERATION ON A REGISTER
+        alu_operation<y>(get_register_byte<reg_z>());
+        return 1 + z_indirect;
 
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, true, false);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
-
-    case 0xA8 ... 0xAF: {
-        // XOR: 0b10101xxx
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        uint8_t value = read_cpu_register_byte(ByteRegister::A) ^ read_cpu_register_byte(target);
-
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, false, false);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
-
-    case 0xB0 ... 0xB7: {
-        // OR: 0b10110xxx
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        uint8_t value = read_cpu_register_byte(ByteRegister::A) | read_cpu_register_byte(target);
-
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, false, false);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
-
-    case 0xB8 ... 0xBF: {
-        // COMPARE WITH REGISTER A: 0b10111xxx
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) ((opcode & 0b00000111) >> 0);
-        uint8_t value = read_cpu_register_byte(target);
-        sub_byte_with_overflow(value, false);
-        return 1 + (target == ByteRegister::HL_INDIRECT);
-    }
+    } else if constexpr (x == 3 && z == 6) {
+        // ALU OPERATION ON AN IMMEDIATE
+        alu_operation<y>(_operands[0]);
+        return 2;
 
-    case 0xC0:
-    case 0xC8:
-    case 0xD0:
-    case 0xD8: {
-        // CONDITIONAL RETURN FROM FUNC: 0b110cc000
-        Condition::Condition cc = (Condition::Condition) ((opcode & 0b00011000) >> 3);
-        if (evaluate_condition(cc)) {
+    } else if constexpr (x == 3 && z == 0 && y < 4) {
+        // CONDITIONAL RETURN FROM FUNC
+        if (check_condition<cc>()) {
             return_function();
             return 5;
         }
         return 2;
-    }
-
-    case 0xC1:
-    case 0xD1:
-    case 0xE1:
-    case 0xF1: {
-        // POP INTO WORD REGISTER: 0b11xx0001
-        WordRegister::WordRegister target;
-        switch ((opcode & 0b00110000) >> 4) {
-        case 0: target = WordRegister::BC; break;
-        case 1: target = WordRegister::DE; break;
-        case 2: target = WordRegister::HL; break;
-        case 3: target = WordRegister::AF; break;
-        default: throw std::invalid_argument("Invalid WordRegister target for POP");
-        }
 
+    } else if constexpr (x == 3 && z == 1 && q == 0) {
+        // POP INTO WORD REGISTER
+        constexpr WordRegister::WordRegister target = (p == 3) ? WordRegister::AF : reg_p;
         uint8_t lsb = gb.read_address(registers.sp++);
         uint8_t msb = gb.read_address(registers.sp++);
-        uint16_t value = (((uint16_t) msb) << 8) | lsb;
-        read_cpu_register_word(target, value);
+        set_register_word<target>((((uint16_t) msb) << 8) | lsb);
         return 3;
-    }
 
-    case 0xC2:
-    case 0xCA:
-    case 0xD2:
-    case 0xDA: {
-        // CONDITIONAL ABSOLUTE JUMP: 0b110cc010
-        Condition::Condition cc = (Condition::Condition) ((opcode & 0b00011000) >> 3);
-        uint8_t lsb = gb.read_address(registers.pc++);
-        uint8_t msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) msb) << 8) | lsb;
-        if (evaluate_condition(cc)) {
+    } else if constexpr (x == 3 && z == 5 && q == 0) {
+        // PUSH WORD REGISTER
+        constexpr WordRegister::WordRegister target = (p == 3) ? WordRegister::AF : reg_p;
+        uint16_t value = get_register_word<target>();
+        gb.write_address(--registers.sp, (value >> 8) & 0xFF);
+        gb.write_address(--registers.sp, value & 0xFF);
+        return 4;
+
+    } else if constexpr (x == 3 && z == 2 && y < 4) {
+        // CONDITIONAL ABSOLUTE JUMP
+        uint16_t addr = immediate_word();
+        if (check_condition<cc>()) {
             registers.pc = addr;
             return 4;
         }
         return 3;
-    }
 
-    case 0xC3: {
-        // UNCONDITIONAL ABSOLUTE JUMP: 0b11000011
-        uint8_t lsb = gb.read_address(registers.pc++);
-        uint8_t msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) msb) << 8) | lsb;
-        registers.pc = addr;
+    } else if constexpr (OPCODE == 0xC3) {
+        // UNCONDITIONAL ABSOLUTE JUMP
+        registers.pc = immediate_word();
         return 4;
-    }
 
-    case 0xC4:
-    case 0xCC:
-    case 0xD4:
-    case 0xDC: {
-        // CONDITIONAL CALL: 0b110cc100
-        Condition::Condition cc = (Condition::Condition) ((opcode & 0b00011000) >> 3);
-        uint8_t addr_lsb = gb.read_address(registers.pc++);
-        uint8_t addr_msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) addr_msb) << 8) | addr_lsb;
-        if (evaluate_condition(cc)) {
+    } else if constexpr (x == 3 && z == 4 && y < 4) {
+        // CONDITIONAL CALL
+        uint16_t addr = immediate_word();
+        if (check_condition<cc>()) {
             call_function(addr);
             return 6;
         }
         return 3;
-    }
-
-    case 0xC5:
-    case 0xD5:
-    case 0xE5:
-    case 0xF5: {
-        // PUSH WORD REGISTER: 0b11xx0101
-        WordRegister::WordRegister target;
-        switch ((opcode & 0b00110000) >> 4) {
-        case 0: target = WordRegister::BC; break;
-        case 1: target = WordRegister::DE; break;
-        case 2: target = WordRegister::HL; break;
-        case 3: target = WordRegister::AF; break;
-        default: throw std::invalid_argument("Invalid WordRegister target for PUSH");
-        }
-
-        uint16_t value = read_cpu_register_word(target);
-        uint8_t msb = (value >> 8) & 0xFF;
-        uint8_t lsb = value & 0xFF;
-
-        gb.write_address(--registers.sp, msb);
-        gb.write_address(--registers.sp, lsb);
-        return 4;
-    }
-
-    case 0xC6:
-    case 0xCE: {
-        // ADD IMMEDIATE: 0b1100c110 (c = use carry)
-        uint8_t value = gb.read_address(registers.pc++);
-        bool use_carry = (opcode & 0b00001000) != 0;
-        uint8_t result = add_byte_with_overflow(value, use_carry);
-        read_cpu_register_byte(ByteRegister::A, result);
-        return 2;
-    }
-
-    case 0xC7:
-    case 0xCF:
-    case 0xD7:
-    case 0xDF:
-    case 0xE7:
-    case 0xEF:
-    case 0xF7:
-    case 0xFF: {
-        // RESTART / CALL FUNCTION (implied): 0b11xxx111
-        uint8_t offset = ((opcode & 0b00111000) >> 3);
-        uint16_t addr = RST_VECTORS + (offset * 0x08);
-        call_function(addr);
 
+    } else if constexpr (x == 3 && z == 7) {
+        // RESTART / CALL FUNCTION (implied)
+        call_function(RST_VECTORS + (y * 0x08));
         return 4;
-    }
 
-    case 0xC9: {
-        // UNCONDITIONAL RETURN FROM FUNC: 0b11001001
+    } else if constexpr (OPCODE == 0xC9) {
+        // UNCONDITIONAL RETURN FROM FUNC
         return_function();
         return 4;
-    }
 
-    case 0xCB: {
-        // CB: 0b11001011
-        uint8_t second_opcode = gb.read_address(registers.pc++);
-        ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) (second_opcode & 0b00000111);
-
-        switch (second_opcode) {
-        case 0x00 ... 0x07: {
-            // ROTATE REGISTER LEFT
-            uint8_t value = read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b10000000) != 0;
-            value <<= 1;
-            value |= shifted_out_bit;
-
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x08 ... 0x0F: {
-            // ROTATE REGISTER RIGHT
-            uint8_t value = read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b00000001) != 0;
-            value >>= 1;
-            value |= (shifted_out_bit << 7);
-
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x10 ... 0x17: {
-            // ROTATE REGISTER LEFT THROUGH CARRY
-            uint8_t value = read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b10000000) != 0;
-            value <<= 1;
-            value |= registers.flags.carry;
-
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x18 ... 0x1F: {
-            // ROTATE REGISTER RIGHT  THROUGH CARRY
-            uint8_t value = read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b00000001) != 0;
-            value >>= 1;
-            value |= (registers.flags.carry << 7);
-
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x20 ... 0x27: {
-            // ARITHMETIC SHIFT LEFT
-            int8_t value = (int8_t) read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b10000000) != 0;
-            value <<= 1;
-            read_cpu_register_byte(target, (uint8_t) value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x28 ... 0x2F: {
-            // ARITHMETIC SHIFT RIGHT
-            int8_t value = (int8_t) read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b00000001) != 0;
-            value >>= 1;
-            read_cpu_register_byte(target, (uint8_t) value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x30 ... 0x37: {
-            // SWAP
-            uint8_t value = read_cpu_register_byte(target);
-            uint8_t lower_nibble = value & 0xF;
-            value >>= 4;
-            value |= (lower_nibble << 4);
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, false);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x38 ... 0x3F: {
-            // LOGICAL SHIFT RIGHT
-            uint8_t value = read_cpu_register_byte(target);
-            bool shifted_out_bit = (value & 0b00000001) != 0;
-            value >>= 1;
-            read_cpu_register_byte(target, value);
-            set_all_flags(value == 0, false, false, shifted_out_bit);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0x40 ... 0x7F: {
-            // TEST BIT IN REGISTER: 0b01bbbxxx (b = bit)
-            uint8_t bit = (second_opcode & 0b00111000) >> 3;
-            uint8_t mask = (1 << bit);
-            uint8_t value = read_cpu_register_byte(target) & mask;
-            registers.flags.zero = value == 0;
-            registers.flags.subtraction = false;
-            registers.flags.half_carry = true;
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 1);
-        }
-        case 0x80 ... 0xBF: {
-            // RESET BIT IN REGISTER 0b10bbbxxx (b = bit)
-            uint8_t bit = (second_opcode & 0b00111000) >> 3;
-            uint8_t mask = ~(1 << bit);
-            uint8_t value = read_cpu_register_byte(target) & mask;
-            read_cpu_register_byte(target, value);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        case 0xC0 ... 0xFF: {
-            // SET BIT IN REGISTER: 0b11bbbxxx (b = bit)
-            uint8_t bit = (second_opcode & 0b00111000) >> 3;
-            uint8_t mask = (1 << bit);
-            uint8_t value = read_cpu_register_byte(target) | mask;
-            read_cpu_register_byte(target, value);
-            return 2 + ((target == ByteRegister::HL_INDIRECT) * 2);
-        }
-        }
-        return 2;
-    }
+    } else if constexpr (OPCODE == 0xCB) {
+        // CB PREFIX
+        return execute_cb_opcode(_operands[0]);
 
-    case 0xCD: {
-        // UNCONDITIOANL CALL: 0b11001101
-        uint8_t addr_lsb = gb.read_address(registers.pc++);
-        uint8_t addr_msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) addr_msb) << 8) | addr_lsb;
-        call_function(addr);
+    } else if constexpr (OPCODE == 0xCD) {
+        // UNCONDITIONAL CALL
+        call_function(immediate_word());
         return 6;
-    }
 
-    case 0xD6:
-    case 0xDE: {
-        // SUBTRACT IMMEDIATE: 0b1101c110 (c = use carry)
-        uint8_t value = gb.read_address(registers.pc++);
-        bool use_carry = (opcode & 0b00001000) != 0;
-        uint8_t result = sub_byte_with_overflow(value, use_carry);
-        read_cpu_register_byte(ByteRegister::A, result);
-        return 2;
-    }
-
-    case 0xD9: {
+    } else if constexpr (OPCODE == 0xD9) {
         // RETURN FROM INTERRUPT
         _ime_flag = true;
         return_function();
         return 4;
-    }
 
-    case 0xE0: {
-        // LD (0xFF00+IMMEDIATE) FROM ACCUMULATOR: 0b11100000
-        uint8_t offset = gb.read_address(registers.pc++);
-        uint16_t addr = 0xFF00 + offset;
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        gb.write_address(addr, value);
+    } else if constexpr (OPCODE == 0xE0 || OPCODE == 0xF0) {
+        // LD (0xFF00+IMMEDIATE) TO/FROM ACCUMULATOR
+        uint16_t addr = 0xFF00 + _operands[0];
+        if constexpr (OPCODE == 0xE0) {
+            gb.write_address(addr, registers.a);
+        } else {
+            registers.a = gb.read_address(addr);
+        }
         return 3;
-    }
 
-    case 0xE2: {
-        // LD (0xFF00+C) FROM ACCUMULATOR: 0b11100010
-        uint8_t offset = read_cpu_register_byte(ByteRegister::C);
-        uint16_t addr = 0xFF00 + offset;
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        gb.write_address(addr, value);
+    } else if constexpr (OPCODE == 0xE2 || OPCODE == 0xF2) {
+        // LD (0xFF00+C) TO/FROM ACCUMULATOR
+        uint16_t addr = 0xFF00 + registers.c;
+        if constexpr (OPCODE == 0xE2) {
+            gb.write_address(addr, registers.a);
+        } else {
+            registers.a = gb.read_address(addr);
+        }
         return 2;
-    }
 
-    case 0xE6: {
-        // AND IMMEDIATE: 0b11100110
-        uint8_t value = gb.read_address(registers.pc++) & read_cpu_register_byte(ByteRegister::A);
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, true, false);
-        return 2;
-    }
-
-    case 0xE8: {
-        // ADD SP,e
-        int8_t value = gb.read_address(registers.pc++);
-        uint16_t current_value = read_cpu_register_word(WordRegister::SP);
+    } else if constexpr (OPCODE == 0xE8 || OPCODE == 0xF8) {
+        // ADD SP,e / LOAD HL WITH SP+e
+        int8_t value = (int8_t) _operands[0];
+        uint16_t current_value = registers.sp;
         uint16_t result = current_value + value;
-        read_cpu_register_word(WordRegister::SP, result);
+        if constexpr (OPCODE == 0xE8) {
+            registers.sp = result;
+        } else {
+            registers.set_hl(result);
+        }
 
         bool half_carry = ((value & 0xF) + (current_value & 0xF)) & 0x10;
         bool carry = ((value & 0xFF) + (current_value & 0xFF)) & 0x100;
         set_all_flags(false, false, half_carry, carry);
-        return 4;
-    }
+        return (OPCODE == 0xE8) ? 4 : 3;
 
-    case 0xE9: {
-        // UNCONDITIONAL JUMP TO HL: 0b11101001
-        registers.pc = read_cpu_register_word(WordRegister::HL);
+    } else if constexpr (OPCODE == 0xE9) {
+        // UNCONDITIONAL JUMP TO HL
+        registers.pc = registers.hl();
         return 1;
-    }
-
-    case 0xEA: {
-        // LOAD ACCUMULATOR TO IMMEDIATE ADDR: 0b11101010
-        uint8_t lsb = gb.read_address(registers.pc++);
-        uint8_t msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) msb) << 8) | lsb;
 
-        uint8_t value = read_cpu_register_byte(ByteRegister::A);
-        gb.write_address(addr, value);
+    } else if constexpr (OPCODE == 0xEA || OPCODE == 0xFA) {
+        // LD (IMMEDIATE ADDR) TO/FROM ACCUMULATOR
+        uint16_t addr = immediate_word();
+        if constexpr (OPCODE == 0xEA) {
+            gb.write_address(addr, registers.a);
+        } else {
+            registers.a = gb.read_address(addr);
+        }
         return 4;
-    }
-
-    case 0xEE: {
-        // XOR IMMEDIATE: 0b11101110
-        uint8_t value = gb.read_address(registers.pc++) ^ read_cpu_register_byte(ByteRegister::A);
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, false, false);
-        return 2;
-    }
 
-    case 0xF0: {
-        // LOAD ACCUMULATOR FROM (0xFF00+IMMEDIATE): 0b11110000
-        uint8_t offset = gb.read_address(registers.pc++);
-        uint16_t addr = 0xFF00 + offset;
-        uint8_t value = gb.read_address(addr);
-        read_cpu_register_byte(ByteRegister::A, value);
-        return 3;
-    }
-
-    case 0xF2: {
-        // LOAD ACCUMULATOR FROM (0xFF00+C): 0b11110010
-        uint8_t offset = read_cpu_register_byte(ByteRegister::C);
-        uint16_t addr = 0xFF00 + offset;
-        uint8_t value = gb.read_address(addr);
-        read_cpu_register_byte(ByteRegister::A, value);
-        return 2;
-    }
-
-    case 0xF3: {
-        // DISABLE INTERRUPTS: 0b11110011
+    } else if constexpr (OPCODE == 0xF3) {
+        // DISABLE INTERRUPTS
         _ime_flag = false;
         _ime_enable_next_cycle = false;
         return 1;
-    }
 
-    case 0xF6: {
-        // OR IMMEDIATE: 0b11110110
-        uint8_t value = gb.read_address(registers.pc++) | read_cpu_register_byte(ByteRegister::A);
-        read_cpu_register_byte(ByteRegister::A, value);
-        set_all_flags(value == 0, false, false, false);
+    } else if constexpr (OPCODE == 0xF9) {
+        // LOAD SP FROM HL WORD
+        registers.sp = registers.hl();
         return 2;
-    }
 
-    case 0xF8: {
-        // LOAD HL WITH SP+offset
-        int8_t value = (int8_t) gb.read_address(registers.pc++);
-        uint16_t current_value = read_cpu_register_word(WordRegister::SP);
-        uint16_t result = current_value + value;
-        read_cpu_register_word(WordRegister::HL, result);
+    } else if constexpr (OPCODE == 0xFB) {
+        // ENABLE INTERRUPTS
+        _ime_enable_next_cycle = true;
+        return 1;
 
-        bool half_carry = ((value & 0xF) + (current_value & 0xF)) & 0x10;
-        bool carry = ((value & 0xFF) + (current_value & 0xFF)) & 0x100;
-        set_all_flags(false, false, half_carry, carry);
-        return 3;
+    } else {
+        // 0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD
+        throw std::invalid_argument("Unknown opcode " + std::to_string(OPCODE));
     }
+}
 
-    case 0xF9: {
-        // LOAD SP FROM HL WORD
-        uint16_t value = read_cpu_register_word(WordRegister::HL);
-        read_cpu_register_word(WordRegister::SP, value);
-        return 2;
+template <uint8_t OPCODE>
+uint8_t CPU::cb_instruction() {
+    constexpr uint8_t x = OPCODE >> 6;
+    constexpr uint8_t y = (OPCODE >> 3) & 0b111;
+    constexpr ByteRegister::ByteRegister target = (ByteRegister::ByteRegister) (OPCODE & 0b111);
+    constexpr bool indirect = target == ByteRegister::HL_INDIRECT;
+
+    if constexpr (x == 0) {
+        // ROTATES AND SHIFTS
+        bool shifted_out_bit;
+        uint8_t value = rotate_shift<y>(get_register_byte<target>(), shifted_out_bit);
+        set_register_byte<target>(value);
+        set_all_flags(value == 0, false, false, shifted_out_bit);
+        return 2 + (indirect * 2);
+
+    } else if constexpr (x == 1) {
+        // TEST BIT IN REGISTER
+        uint8_t value = get_register_byte<target>() & (1 << y);
+        set_all_flags(value == 0, false, true, registers.flags.carry());
+        return 2 + indirect;
+
+    } else if constexpr (x == 2) {
+        // RESET BIT IN REGISTER
+        set_register_byte<target>(get_register_byte<target>() & ~(1 << y));
+        return 2 + (indirect * 2);
+
+    } else {
+        // SET BIT IN REGISTER
+        set_register_byte<target>(get_register_byte<target>() | (1 << y));
+        return 2 + (indirect * 2);
     }
+}
 
-    case 0xFA: {
-        // LOAD ACCUMULATOR ABSOLUTE: 0b11111010
-        uint8_t lsb = gb.read_address(registers.pc++);
-        uint8_t msb = gb.read_address(registers.pc++);
-        uint16_t addr = (((uint16_t) msb) << 8) | lsb;
-        uint8_t value = gb.read_address(addr);
-        read_cpu_register_byte(ByteRegister::A, value);
-        return 4;
+// ADD, ADC, SUB, SBC, AND, XOR, OR, CP
+template <uint8_t OPERATION>
+void CPU::alu_operation(uint8_t value) {
+    if constexpr (OPERATION <= 1) {
+        registers.a = add_byte_with_overflow(value, OPERATION == 1);
+    } else if constexpr (OPERATION <= 3) {
+        registers.a = sub_byte_with_overflow(value, OPERATION == 3);
+    } else if constexpr (OPERATION == 4) {
+        registers.a &= value;
+        registers.flags.record_and(registers.a);
+    } else if constexpr (OPERATION == 5) {
+        registers.a ^= value;
+        registers.flags.record_or(registers.a);
+    } else if constexpr (OPERATION == 6) {
+        registers.a |= value;
+        registers.flags.record_or(registers.a);
+    } else {
+        sub_byte_with_overflow(value, false);
     }
+}
 
-    case 0xFB: {
-        // ENABLE INTERRUPTS: 0b11111011
-        _ime_enable_next_cycle = true;
-        return 1;
+// RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL. The flags are left to the caller.
+template <uint8_t OPERATION>
+uint8_t CPU::rotate_shift(uint8_t value, bool& shifted_out_bit) {
+    if constexpr (OPERATION == 0) {
+        shifted_out_bit = (value & 0b10000000) != 0;
+        value = (value << 1) | shifted_out_bit;
+    } else if constexpr (OPERATION == 1) {
+        shifted_out_bit = (value & 0b00000001) != 0;
+        value = (value >> 1) | (shifted_out_bit << 7);
+    } else if constexpr (OPERATION == 2) {
+        shifted_out_bit = (value & 0b10000000) != 0;
+        value = (value << 1) | registers.flags.carry();
+    } else if constexpr (OPERATION == 3) {
+        shifted_out_bit = (value & 0b00000001) != 0;
+        value = (value >> 1) | (registers.flags.carry() << 7);
+    } else if constexpr (OPERATION == 4) {
+        shifted_out_bit = (value & 0b10000000) != 0;
+        value <<= 1;
+    } else if constexpr (OPERATION == 5) {
+        shifted_out_bit = (value & 0b00000001) != 0;
+        value = (uint8_t) (((int8_t) value) >> 1);
+    } else if constexpr (OPERATION == 6) {
+        shifted_out_bit = false;
+        value = (value >> 4) | (value << 4);
+    } else {
+        shifted_out_bit = (value & 0b00000001) != 0;
+        value >>= 1;
     }
+    return value;
+}
 
-    case 0xFE: {
-        // COMPARE IMMEDIATE WITH ACCUMULATOR: 0b11111110
-        uint8_t value = gb.read_address(registers.pc++);
-        sub_byte_with_overflow(value, false);
-        return 2;
-    }
+template <ByteRegister::ByteRegister REGISTER>
+uint8_t CPU::get_register_byte() {
+    if constexpr (REGISTER == ByteRegister::A) return registers.a;
+    else if constexpr (REGISTER == ByteRegister::B) return registers.b;
+    else if constexpr (REGISTER == ByteRegister::C) return registers.c;
+    else if constexpr (REGISTER == ByteRegister::D) return registers.d;
+    else if constexpr (REGISTER == ByteRegister::E) return registers.e;
+    else if constexpr (REGISTER == ByteRegister::H) return registers.h;
+    else if constexpr (REGISTER == ByteRegister::L) return registers.l;
+    else return gb.read_address(registers.hl());
+}
 
-    default: {
-        // std::cerr << "Unknown opcode! 0x" << std::hex << std::uppercase << std::setw(2) << (int) opcode << std::endl;
-        throw std::invalid_argument("Unknown opcode " + opcode);
-        return 1;
-    }
-    }
+template <ByteRegister::ByteRegister REGISTER>
+void CPU::set_register_byte(uint8_t value) {
+    if constexpr (REGISTER == ByteRegister::A) registers.a = value;
+    else if constexpr (REGISTER == ByteRegister::B) registers.b = value;
+    else if constexpr (REGISTER == ByteRegister::C) registers.c = value;
+    else if constexpr (REGISTER == ByteRegister::D) registers.d = value;
+    else if constexpr (REGISTER == ByteRegister::E) registers.e = value;
+    else if constexpr (REGISTER == ByteRegister::H) registers.h = value;
+    else if constexpr (REGISTER == ByteRegister::L) registers.l = value;
+    else gb.write_address(registers.hl(), value);
+}
+
+template <WordRegister::WordRegister REGISTER>
+uint16_t CPU::get_register_word() {
+    if constexpr (REGISTER == WordRegister::BC) return registers.bc();
+    else if constexpr (REGISTER == WordRegister::DE) return registers.de();
+    else if constexpr (REGISTER == WordRegister::HL) return registers.hl();
+    else if constexpr (REGISTER == WordRegister::SP) return registers.sp;
+    else return registers.af();
+}
+
+template <WordRegister::WordRegister REGISTER>
+void CPU::set_register_word(uint16_t value) {
+    if constexpr (REGISTER == WordRegister::BC) registers.set_bc(value);
+    else if constexpr (REGISTER == WordRegister::DE) registers.set_de(value);
+    else if constexpr (REGISTER == WordRegister::HL) registers.set_hl(value);
+    else if constexpr (REGISTER == WordRegister::SP) registers.sp = value;
+    else registers.set_af(value);
+}
+
+template <Condition::Condition CONDITION>
+bool CPU::check_condition() {
+    if constexpr (CONDITION == Condition::NONZERO) return !registers.flags.zero();
+    else if constexpr (CONDITION == Condition::ZERO) return registers.flags.zero();
+    else if constexpr (CONDITION == Condition::NOCARRY) return !registers.flags.carry();
+    else return registers.flags.carry();
 }
 
 uint8_t CPU::read_io_register(uint16_t address) {
@@ -864,39 +659,31 @@ uint8_t CPU::read_io_register(uint16_t address) {
 
 void CPU::write_io_register(uint16_t address, uint8_t value) {
     switch (address) {
-    case IF: _interrupt_flags = value & 0x1F; break;
+    case IF: set_interrupt_flags(value); break;
     default: break;
     }
 }
 
 uint8_t CPU::check_for_interrupts() {
-    uint8_t ie = gb.read_address(IE, true);
-    if (!_ime_flag) {
-        if (_halted && (ie & _interrupt_flags & 0x1F)) {
-            _halted = false;
-        }
+    if (!_pending_interrupts) {
         return 0;
     }
-
-    uint8_t pending_interrupts = ie & _interrupt_flags & 0x1F;
-    int lowest_set_bit_index = __builtin_ctz(pending_interrupts);
-    if (lowest_set_bit_index <= 4) {
-        uint16_t addr = INTERRUPT_VECTORS + (lowest_set_bit_index * 0x8);
-        _ime_flag = false;
+    if (!_ime_flag) {
         _halted = false;
-        call_function(addr);
-        _interrupt_flags = 0;
-        return 5;
+        return 0;
     }
 
-    return 0;
+    int lowest_set_bit_index = __builtin_ctz(_pending_interrupts);
+    uint16_t addr = INTERRUPT_VECTORS + (lowest_set_bit_index * 0x8);
+    _ime_flag = false;
+    _halted = false;
+    call_function(addr);
+    set_interrupt_flags(0);
+    return 5;
 }
 
 void CPU::set_all_flags(bool zero, bool subtraction, bool half_carry, bool carry) {
-    registers.flags.zero = zero;
-    registers.flags.subtraction = subtraction;
-    registers.flags.half_carry = half_carry;
-    registers.flags.carry = carry;
+    registers.flags.set_all(zero, subtraction, half_carry, carry);
 }
 
 uint8_t CPU::read_cpu_register_byte(ByteRegister::ByteRegister target) {
@@ -949,34 +736,23 @@ void CPU::read_cpu_register_word(WordRegister::WordRegister target, uint16_t val
     }
 }
 
+// Only the operands are recorded, the flags are evaluated when they are read.
 uint8_t CPU::add_byte_with_overflow(uint8_t value, bool add_carry) {
-    uint8_t current_value = registers.a;
-    uint8_t carry_value = add_carry & registers.flags.carry;
-    uint8_t result = current_value + value + carry_value;
-
-    bool half_carry = ((current_value & 0xF) + (value & 0xF) + carry_value) & 0x10;
-    bool carry = result < (value + carry_value) || result < (current_value + carry_value);
-    set_all_flags(result == 0, false, half_carry, carry);
-    return result;
+    uint8_t carry_value = add_carry && registers.flags.carry();
+    return registers.flags.record_add(registers.a, value, carry_value);
 }
 
 uint8_t CPU::sub_byte_with_overflow(uint8_t value, bool sub_carry) {
-    uint8_t current_value = registers.a;
-    uint8_t carry_value = sub_carry & registers.flags.carry;
-    uint8_t result = current_value - value - carry_value;
-
-    bool half_carry = ((current_value & 0xF) - (value & 0xF) - carry_value) & 0x10;
-    bool carry = current_value < (value + carry_value);
-    set_all_flags(result == 0, true, half_carry, carry);
-    return result;
+    uint8_t carry_value = sub_carry && registers.flags.carry();
+    return registers.flags.record_sub(registers.a, value, carry_value);
 }
 
 bool CPU::evaluate_condition(Condition::Condition cc) {
     switch (cc) {
-    case Condition::NONZERO: return !registers.flags.zero;
-    case Condition::ZERO: return registers.flags.zero;
-    case Condition::NOCARRY: return !registers.flags.carry;
-    case Condition::CARRY: return registers.flags.carry;
+    case Condition::NONZERO: return !registers.flags.zero();
+    case Condition::ZERO: return registers.flags.zero();
+    case Condition::NOCARRY: return !registers.flags.carry();
+    case Condition::CARRY: return registers.flags.carry();
     default: throw std::invalid_argument("Unknown conditional value " + cc);
     }
 }
@@ -1013,4 +789,44 @@ void CPU::reset() {
     registers.sp = 0xFFFE;
 
     // TODO: post initialization register values
+}
+
+void CPU::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(registers.a);
+    state.write(registers.f());
+    state.write(registers.b);
+    state.write(registers.c);
+    state.write(registers.d);
+    state.write(registers.e);
+    state.write(registers.h);
+    state.write(registers.l);
+    state.write(registers.sp);
+    state.write(registers.pc);
+    state.write(_interrupt_flags);
+    state.write(_interrupt_enable);
+    state.write(_ime_flag);
+    state.write(_ime_enable_next_cycle);
+    state.write(_halted);
+    state.write(halt_bug);
+}
+
+void CPU::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(registers.a);
+    registers.set_f(state.read<uint8_t>());
+    state.read(registers.b);
+    state.read(registers.c);
+    state.read(registers.d);
+    state.read(registers.e);
+    state.read(registers.h);
+    state.read(registers.l);
+    state.read(registers.sp);
+    state.read(registers.pc);
+    set_interrupt_flags(state.read<uint8_t>());
+    set_interrupt_enable(state.read<uint8_t>());
+    state.read(_ime_flag);
+    state.read(_ime_enable_next_cycle);
+    state.read(_halted);
+    state.read(halt_bug);
 }
\ No newline at end of file
@@ -8,13 +8,36 @@ DMAController::DMAController(GBSystem& gb) :
     gb.add_register_callbacks(this, {DMA});
 }
 
-void DMAController::tick() {
-    if (_counter < 160) {
+void DMAController::sync(uint64_t cycle) {
+    bool was_active = active();
+
+    // One byte is transferred per cycle
+    while (_counter < 160 && _sync_cycle <= cycle) {
         uint16_t source_addr = _source_addr_msb | _counter;
         uint16_t dest_addr = 0xFE00 | _counter;
 
         gb.write_address(dest_addr, gb.read_address(source_addr, true), true);
         _counter++;
+        _sync_cycle++;
+    }
+
+    if (_sync_cycle <= cycle) {
+        _sync_cycle = cycle + 1;
+    }
+
+    if (!active()) {
+        gb.scheduler().cancel(SchedulerEvent::DMA);
+    }
+    if (was_active && !active()) {
+        // Memory is accessible again
+        gb.update_memory_map();
+    }
+}
+
+void DMAController::reset_sync_cycle() {
+    GBComponent::reset_sync_cycle();
+    if (active()) {
+        gb.scheduler().schedule(SchedulerEvent::DMA, _sync_cycle + (159 - _counter));
     }
 }
 
@@ -37,7 +60,21 @@ void DMAController::write_io_register(uint16_t address, uint8_t value) {
 
         _source_addr_msb = ((uint16_t) value) << 8;
         _counter = 0;
+        gb.scheduler().schedule(SchedulerEvent::DMA, _sync_cycle + 159);
+        gb.update_memory_map();
         break;
     }
     }
+}
+
+void DMAController::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(_counter);
+    state.write(_source_addr_msb);
+}
+
+void DMAController::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(_counter);
+    state.read(_source_addr_msb);
 }
\ No newline at end of file
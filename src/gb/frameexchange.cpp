@@ -0,0 +1,44 @@
+#include "frameexchange.h"
+#include <cstring>
+
+FrameExchange::FrameExchange(size_t frame_size) {
+    for (std::vector<uint8_t>& buffer : _buffers) {
+        buffer.assign(frame_size, 0);
+    }
+}
+
+void FrameExchange::publish() {
+    // Release makes the frame visible to the consumer, acquire hands us the buffer it gave back
+    uint8_t previous = _middle.exchange(_back | FRESH_FRAME, std::memory_order_acq_rel);
+    if (previous & FRESH_FRAME) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    _back = previous & ~FRESH_FRAME;
+    _published.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameExchange::publish(const uint8_t* frame) {
+    std::memcpy(back_buffer(), frame, frame_size());
+    publish();
+}
+
+const uint8_t* FrameExchange::acquire() {
+    // Only the consumer clears FRESH_FRAME, so the frame seen here is still there to swap for
+    if (_middle.load(std::memory_order_relaxed) & FRESH_FRAME) {
+        uint8_t middle = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = middle & ~FRESH_FRAME;
+        _presented.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _duplicated.fetch_add(1, std::memory_order_relaxed);
+    }
+    return _buffers[_front].data();
+}
+
+FrameExchangeStats FrameExchange::stats() const {
+    FrameExchangeStats stats;
+    stats.published = _published.load(std::memory_order_relaxed);
+    stats.presented = _presented.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.duplicated = _duplicated.load(std::memory_order_relaxed);
+    return stats;
+}
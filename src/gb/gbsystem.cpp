@@ -1,5 +1,10 @@
 #include "gbsystem.h"
+#include <algorithm>
 #include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
 #include "gbcomponent.h"
 #include "memorymap.h"
 #include "registers.h"
@@ -10,51 +15,319 @@ GBSystem::GBSystem(bool cgb) :
     if (cgb) {
         clock_speed *= 2;
     }
+    _next_frame_cycle = cycles_per_frame();
+    update_memory_map();
+    restart_components();
 }
 
 void GBSystem::reset() {
     cycles = 0;
-    timer_cycles = 0;
+    _next_frame_cycle = cycles_per_frame();
+    _scheduler.clear();
+    restart_components();
 
     cpu().reset();
+    flush_code_cache();
+    update_memory_map();
+
+    if (_lockstep) {
+        _lockstep->reset();
+    }
+}
+
+void GBSystem::set_cpu_backend(CPUBackend::CPUBackend backend) {
+    bool recompiled = backend == CPUBackend::Recompiled || backend == CPUBackend::RecompiledLockstep;
+    if (recompiled && !cpu().recompiled().module()) {
+        throw std::runtime_error("No recompiled module is linked in for this ROM");
+    }
+    cpu().jit().set_enabled(backend == CPUBackend::JIT || backend == CPUBackend::JITLockstep);
+    _lockstep.reset();
+    _cpu_backend = backend;
+
+    if (backend == CPUBackend::JITLockstep || backend == CPUBackend::RecompiledLockstep) {
+        std::vector<uint8_t> rom = cartridge().rom();
+        std::vector<uint8_t> state;
+        save_state(state);
+
+        _lockstep.reset(new GBSystem(_cgb));
+        _lockstep->cartridge().load_rom(rom);
+        _lockstep->load_state(state);
+    }
+}
+
+void GBSystem::restart_components() {
+    // run_until only syncs components at a deadline, so theirs have to be scheduled before
+    // the CPU runs, or nothing would happen until the end of the frame
+    cpu().reset_sync_cycle();
+    ppu().reset_sync_cycle();
+    apu().reset_sync_cycle();
+    timer().reset_sync_cycle();
+    dma().reset_sync_cycle();
+    joypad().reset_sync_cycle();
+}
+
+void GBSystem::save_state(std::vector<uint8_t>& state) {
+    // Components are saved as they are, lagging behind or not. Their sync cycles and
+    // the scheduler deadlines are part of the state, so they catch up identically later.
+    state.clear();
+    StateWriter writer(state);
+    writer.write(SAVE_STATE_MAGIC);
+    writer.write(SAVE_STATE_VERSION);
+    writer.write(_cgb);
+
+    cartridge().save_state(writer);
+
+    writer.write(clock_speed);
+    writer.write(cycles);
+    writer.write(frame_number);
+    writer.write(_next_frame_cycle);
+    writer.write_bytes(_wram, WRAM_SIZE * (_cgb ? WRAM_BANKS : 2)); // Unused banks are skipped
+    writer.write(_hram);
+    _scheduler.save_state(writer);
+
+    cpu().save_state(writer);
+    ppu().save_state(writer);
+    apu().save_state(writer);
+    timer().save_state(writer);
+    dma().save_state(writer);
+    joypad().save_state(writer);
+}
+
+void GBSystem::load_state(const std::vector<uint8_t>& state) {
+    StateReader reader(state);
+    read_state_header(reader);
+
+    // The rest can still turn out to be truncated or for another ROM halfway through, so
+    // keep the current state to go back to rather than leave the system half loaded
+    std::vector<uint8_t> previous;
+    save_state(previous);
+    try {
+        read_state(reader);
+        if (reader.remaining() != 0) {
+            throw std::invalid_argument("Save state has trailing data");
+        }
+    } catch (...) {
+        StateReader previous_reader(previous);
+        read_state_header(previous_reader);
+        read_state(previous_reader);
+        throw;
+    }
+
+    if (_lockstep) {
+        _lockstep->load_state(state);
+    }
+}
+
+void GBSystem::read_state_header(StateReader& reader) {
+    if (reader.read<uint32_t>() != SAVE_STATE_MAGIC) {
+        throw std::invalid_argument("Not a save state");
+    }
+    if (reader.read<uint16_t>() != SAVE_STATE_VERSION) {
+        throw std::invalid_argument("Unsupported save state version");
+    }
+    if (reader.read<bool>() != _cgb) {
+        throw std::invalid_argument("Save state is for a different hardware model");
+    }
 }
 
-bool GBSystem::tick() {
+void GBSystem::read_state(StateReader& reader) {
+    cartridge().load_state(reader);
+
+    reader.read(clock_speed);
+    reader.read(cycles);
+    reader.read(frame_number);
+    reader.read(_next_frame_cycle);
+    reader.read_bytes(_wram, WRAM_SIZE * (_cgb ? WRAM_BANKS : 2));
+    reader.read(_hram);
+    _scheduler.load_state(reader);
+
+    cpu().load_state(reader);
+    ppu().load_state(reader);
+    apu().load_state(reader);
+    timer().load_state(reader);
+    dma().load_state(reader);
+    joypad().load_state(reader);
+
+    flush_code_cache();
+    update_memory_map();
+}
 
-    // Timer
-    timer().tick();
+void GBSystem::run_frame() {
+    uint64_t halt_cycles = skip_stats.halt_cycles;
+    uint64_t idle_loop_cycles = skip_stats.idle_loop_cycles;
+    run_until(_next_frame_cycle);
+    skip_stats.last_frame_halt_cycles = skip_stats.halt_cycles - halt_cycles;
+    skip_stats.last_frame_idle_loop_cycles = skip_stats.idle_loop_cycles - idle_loop_cycles;
+
+    // Leave every component exactly at the frame boundary.
+    sync_to(_next_frame_cycle - 1);
+    _next_frame_cycle += cycles_per_frame();
+    frame_number++;
+
+    if (_lockstep) {
+        _lockstep->joypad().set_inputs(joypad().inputs());
+        _lockstep->run_frame();
+    }
+}
 
-    // PPU
-    ppu().tick();
+void GBSystem::run_until(uint64_t cycle) {
+    // Inputs may have changed since the last run
+    _run_until_cycle = cycle;
+    _idle_loop = IdleLoopVisit();
 
-    // APU
-    apu().tick();
+    while (cycles < cycle) {
+        if (cycles >= _scheduler.next_deadline()) {
+            // Something (an interrupt, a mode change, ...) happened since the last catch up.
+            sync_to(cycles);
+        }
 
-    // DMA
-    dma().tick();
+        if (cpu().halted() && skip_halt(cycle)) {
+            continue;
+        }
 
-    // Joypad
-    joypad().tick();
+        uint32_t native_instructions = 0;
+        switch (_cpu_backend) {
+        case CPUBackend::JIT:
+        case CPUBackend::JITLockstep: native_instructions = cpu().jit().run(cycle); break;
+        case CPUBackend::Recompiled:
+        case CPUBackend::RecompiledLockstep: native_instructions = cpu().recompiled().run(cycle); break;
+        default: break;
+        }
+        if (native_instructions) {
+            if (_lockstep) {
+                check_lockstep();
+            }
+            continue;
+        }
 
-    // 4 clock cycles = 1 CPU cycle
-    if (cycles % 4 == 0) {
-        cpu().tick();
+        // 4 clock cycles = 1 CPU cycle
+        cycles += cpu().step() * 4;
     }
+}
 
-    frame_cycles++;
-    cycles++;
-    if (frame_cycles == (int) (clock_speed / 59.7275)) {
-        frame_number++;
-        frame_cycles = 0;
+bool GBSystem::skip_halt(uint64_t cycle) {
+    // Interrupts are only requested when components catch up, at a deadline. Until then
+    // every step of a halted CPU just adds 4 cycles, so take them all at once.
+    if (!cpu().waiting_for_interrupt()) {
+        return false;
+    }
+    uint64_t target = std::min(cycle, _scheduler.next_deadline());
+    if (target <= cycles) {
+        return false;
+    }
+    uint64_t skipped = (target - cycles + 3) & ~(uint64_t) 3;
+    cycles += skipped;
+    skip_stats.halt_cycles += skipped;
+    return true;
+}
+
+// Memory that only changes when a component catches up at a deadline, or when the CPU
+// writes to it: RAM, and the joypad, interrupt and most PPU registers.
+static bool pollable_address(uint16_t address) {
+    if (address >= WRAM_BANK0_START && address < ERAM_START) {
+        return true;
+    }
+    if (address >= HRAM_START) {
         return true;
     }
-    return false;
+    return address == JOYP || address == IF || (address >= LCDC && address <= WX && address != DMA);
+}
+
+bool GBSystem::skip_idle_loop(const DecodedInstruction& head) {
+    if (!_idle_loop_skipping) {
+        return false;
+    }
+
+    uint16_t address;
+    const Registers& registers = cpu().registers;
+    switch (head.code[0]) {
+    case 0xF0: address = 0xFF00 + head.operands[0]; break;
+    case 0xFA: address = (((uint16_t) head.operands[1]) << 8) | head.operands[0]; break;
+    case 0x0A: address = registers.bc(); break;
+    case 0x1A: address = registers.de(); break;
+    default: address = registers.hl(); break;
+    }
+    if (!pollable_address(address)) {
+        return false;
+    }
+
+    // Back exactly one iteration later, with no catch up in between: the last iteration
+    // read the same value as this one will, and every iteration until the deadline too.
+    // Any other way back to the head is longer than the loop itself.
+    uint64_t period = head.idle_loop_cycles * 4;
+    uint64_t deadline = _scheduler.next_deadline();
+    bool repeated = _idle_loop.code == head.code && _idle_loop.deadline == deadline && cycles - _idle_loop.cycle == period;
+    _idle_loop = { head.code, cycles, deadline };
+    if (!repeated) {
+        return false;
+    }
+
+    // Only whole iterations that end before anything could happen mid-loop
+    uint64_t limit = std::min(deadline, _run_until_cycle);
+    uint64_t iterations = limit > cycles ? (limit - cycles) / period : 0;
+    if (!iterations) {
+        return false;
+    }
+    cycles += iterations * period;
+    skip_stats.idle_loop_cycles += iterations * period;
+    _idle_loop.cycle = cycles;
+    return true;
 }
 
-uint8_t GBSystem::read_address(uint16_t address, bool internal) {
+void GBSystem::check_lockstep() {
+    // The copy catches up on everything since the last block, then runs this one
+    _lockstep->joypad().set_inputs(joypad().inputs());
+    _lockstep->run_until(cycles);
+
+    const Registers& expected = _lockstep->cpu().registers;
+    const Registers& actual = cpu().registers;
+    if (_lockstep->cycles == cycles && expected == actual) {
+        return;
+    }
+
+    auto describe = [](std::ostringstream& out, const Registers& r, uint64_t cycle) {
+        out << std::hex << std::setfill('0')
+            << "AF=" << std::setw(4) << r.af() << " BC=" << std::setw(4) << r.bc()
+            << " DE=" << std::setw(4) << r.de() << " HL=" << std::setw(4) << r.hl()
+            << " SP=" << std::setw(4) << r.sp << " PC=" << std::setw(4) << r.pc
+            << std::dec << " cycle " << cycle;
+    };
+    std::ostringstream message;
+    message << "Native code and interpreter disagree after a block" << std::endl << "  native:      ";
+    describe(message, actual, cycles);
+    message << std::endl << "  interpreter: ";
+    describe(message, expected, _lockstep->cycles);
+    throw std::runtime_error(message.str());
+}
+
+void GBSystem::sync_to(uint64_t cycle) {
+    _syncing = true;
+
+    // APU reads DIV, so the timer goes first.
+    timer().sync(cycle);
+
+    // The PPU's OAM scan observes the DMA, so step them together while one is running.
+    while (dma().active() && dma().sync_cycle() <= cycle) {
+        uint64_t dma_cycle = dma().sync_cycle();
+        ppu().sync(dma_cycle);
+        dma().sync(dma_cycle);
+    }
+    ppu().sync(cycle);
+    dma().sync(cycle);
+
+    apu().sync(cycle);
+    joypad().sync(cycle);
+
+    _syncing = false;
+}
+
+uint8_t GBSystem::read_address_slow(uint16_t address, bool internal) {
 
     if (address >= IO_REGISTERS_START && address < (IO_REGISTERS_START + IO_REGISTERS_SIZE)) {
         // IO Registers
+        if (!_syncing) {
+            sync_to(cycles);
+        }
         GBComponent* handling_component = register_handlers[address - IO_REGISTERS_START];
         if (handling_component) {
             return handling_component->read_io_register(address);
@@ -64,9 +337,17 @@ uint8_t GBSystem::read_address(uint16_t address, bool internal) {
 
     if (address >= HRAM_START && address < (HRAM_START + HRAM_SIZE)) {
         // HRAM
+        if (address == IE) {
+            return cpu().interrupt_enable();
+        }
         return _hram[address - HRAM_START];
     }
 
+    if (!internal && dma().active()) {
+        // The transfer may have finished since the DMA was last caught up
+        sync_to(cycles);
+    }
+
     // TODO: ROM is readable on GBC, apparently.
     if (!internal && dma().active()) {
         // Cannot access non-HRAM during DMA
@@ -103,10 +384,13 @@ uint8_t GBSystem::read_address(uint16_t address, bool internal) {
     return 0xFF;
 }
 
-void GBSystem::write_address(uint16_t address, uint8_t value, bool internal) {
+void GBSystem::write_address_slow(uint16_t address, uint8_t value, bool internal) {
 
     if (address >= IO_REGISTERS_START && address < (IO_REGISTERS_START + IO_REGISTERS_SIZE)) {
         // IO Registers
+        if (!_syncing) {
+            sync_to(cycles);
+        }
         GBComponent* handling_component = register_handlers[address - IO_REGISTERS_START];
         if (handling_component) {
             handling_component->write_io_register(address, value);
@@ -116,10 +400,23 @@ void GBSystem::write_address(uint16_t address, uint8_t value, bool internal) {
 
     if (address >= HRAM_START && address < (HRAM_START + HRAM_SIZE)) {
         // HRAM
+        if (_hram_code) {
+            cpu().block_cache().invalidate(HRAM_START, _hram);
+            cpu().jit().invalidate(HRAM_START, _hram);
+            _hram_code = false;
+        }
         _hram[address - HRAM_START] = value;
+        if (address == IE) {
+            cpu().set_interrupt_enable(value);
+        }
         return;
     }
 
+    if (!internal && dma().active()) {
+        // The transfer may have finished since the DMA was last caught up
+        sync_to(cycles);
+    }
+
     if (!internal && dma().active()) {
         // Cannot access non-HRAM during DMA
         return;
@@ -144,6 +441,14 @@ void GBSystem::write_address(uint16_t address, uint8_t value, bool internal) {
         } else {
             address -= WRAM_BANK0_START;
         }
+        if (_wram_code_pages[address >> 8]) {
+            // Code is being overwritten
+            uint16_t page_start = address & 0xFF00;
+            cpu().block_cache().invalidate(page_start, _wram + page_start);
+            cpu().jit().invalidate(page_start, _wram + page_start);
+            _wram_code_pages[address >> 8] = false;
+            update_wram_page(page_start);
+        }
         _wram[address] = value;
         return;
     }
@@ -168,7 +473,77 @@ void GBSystem::add_register_callbacks_range(GBComponent* component, uint16_t add
 }
 
 bool GBSystem::request_interrupt(Interrupts::Interrupts interrupt) {
-    uint8_t old_value = read_address(IF, true);
-    write_address(IF, old_value | (uint8_t) interrupt, true);
-    return (old_value & (uint8_t) interrupt) == 0;
+    return cpu().request_interrupt((uint8_t) interrupt);
 }
+
+void GBSystem::update_memory_map(uint16_t start_address, uint16_t end_address) {
+    // A compiled block may be running from memory that is about to move
+    cpu().request_block_exit();
+
+    for (uint32_t page = start_address >> 8; page <= (uint32_t) (end_address >> 8); page++) {
+        uint16_t address = page << 8;
+        const uint8_t* read_page = nullptr;
+        uint8_t* write_page = nullptr;
+
+        if (dma().active()) {
+            // Only HRAM is accessible, which is handled by the slow path anyway.
+
+        } else if (address < (ROM_START + (ROM_SIZE * 2))) {
+            // ROM
+            read_page = cartridge().read_page(address);
+
+        } else if (address < (VRAM_START + VRAM_SIZE)) {
+            // VRAM
+            if (ppu().vram_accessible()) {
+                read_page = ppu().vram_page(address);
+                write_page = ppu().vram_write_page(address);
+            }
+
+        } else if (address < (SRAM_START + SRAM_SIZE)) {
+            // SRAM
+            read_page = cartridge().read_page(address);
+            write_page = cartridge().write_page(address);
+
+        } else if (address < (ERAM_START + ERAM_SIZE)) {
+            // WRAM / ERAM
+            uint16_t wram_address = ((address >= ERAM_START) ? address - 0x2000 : address) - WRAM_BANK0_START;
+            read_page = _wram + wram_address;
+            if (!_wram_code_pages[wram_address >> 8]) {
+                write_page = _wram + wram_address;
+            }
+        }
+
+        _read_pages[page] = read_page;
+        _write_pages[page] = write_page;
+    }
+}
+
+void GBSystem::protect_code(uint16_t address) {
+    if (address >= HRAM_START) {
+        _hram_code = true;
+
+    } else if (address >= WRAM_BANK0_START) {
+        uint16_t wram_address = ((address >= ERAM_START) ? address - 0x2000 : address) - WRAM_BANK0_START;
+        if (!_wram_code_pages[wram_address >> 8]) {
+            _wram_code_pages[wram_address >> 8] = true;
+            update_wram_page(wram_address & 0xFF00);
+        }
+    }
+}
+
+void GBSystem::flush_code_cache() {
+    cpu().block_cache().clear();
+    cpu().jit().clear();
+    std::fill(std::begin(_wram_code_pages), std::end(_wram_code_pages), false);
+    _hram_code = false;
+    update_memory_map(WRAM_BANK0_START, ERAM_START + ERAM_SIZE - 1);
+}
+
+void GBSystem::update_wram_page(uint16_t wram_address) {
+    // The page is also mirrored in echo RAM
+    uint16_t address = WRAM_BANK0_START + wram_address;
+    update_memory_map(address, address + 0xFF);
+    if (address + 0x2000 < ERAM_START + ERAM_SIZE) {
+        update_memory_map(address + 0x2000, address + 0x20FF);
+    }
+}
\ No newline at end of file
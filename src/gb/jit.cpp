@@ -0,0 +1,378 @@
+#include "jit.h"
+#include <cstring>
+#include <stdexcept>
+#include "gbsystem.h"
+
+#ifdef SCGBE_JIT_X64
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace {
+
+// Just enough of an x86-64 assembler for the block templates. Every memory operand
+// is [rbx + disp32], with rbx pointing at the CPU.
+class Emitter {
+
+    private:
+    uint8_t* _start;
+    uint8_t* _position;
+
+    public:
+    Emitter(uint8_t* start) :
+        _start(start),
+        _position(start)
+    {}
+
+    size_t size() const {
+        return _position - _start;
+    }
+
+    size_t position() const {
+        return size();
+    }
+
+    void byte(uint8_t value) {
+        *_position++ = value;
+    }
+
+    void word(uint16_t value) {
+        std::memcpy(_position, &value, 2);
+        _position += 2;
+    }
+
+    void dword(uint32_t value) {
+        std::memcpy(_position, &value, 4);
+        _position += 4;
+    }
+
+    void qword(uint64_t value) {
+        std::memcpy(_position, &value, 8);
+        _position += 8;
+    }
+
+    // ModRM for [rbx + disp32] with the given register/extension field
+    void rbx_operand(uint8_t reg, int32_t disp) {
+        byte(0x80 | (reg << 3) | 3);
+        dword(disp);
+    }
+
+    // Jumps with a 32 bit displacement, returning where to patch it
+    size_t jump(uint8_t condition) {
+        byte(0x0F);
+        byte(condition);
+        dword(0);
+        return position() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = (int32_t) (target - (at + 4));
+        std::memcpy(_start + at, &rel, 4);
+    }
+};
+
+constexpr uint8_t JAE = 0x83;
+constexpr uint8_t JNE = 0x85;
+constexpr uint8_t RAX = 0;
+constexpr uint8_t AH = 4;
+
+}
+
+Jit::Jit(GBSystem& gb_param, CPU& cpu) :
+    gb(gb_param),
+    _cpu(cpu)
+{}
+
+Jit::~Jit() {
+#ifdef SCGBE_JIT_X64
+    if (_code) {
+#ifdef _WIN32
+        VirtualFree(_code, 0, MEM_RELEASE);
+#else
+        munmap(_code, CODE_BUFFER_SIZE);
+#endif
+    }
+#endif
+}
+
+bool Jit::available() {
+#ifdef SCGBE_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::set_enabled(bool enabled) {
+    if (enabled && !_code) {
+#ifdef SCGBE_JIT_X64
+#ifdef _WIN32
+        _code = (uint8_t*) VirtualAlloc(nullptr, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+        void* memory = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        _code = (memory == MAP_FAILED) ? nullptr : (uint8_t*) memory;
+#endif
+        if (!_code) {
+            throw std::runtime_error("Could not allocate executable memory for the JIT");
+        }
+#else
+        throw std::invalid_argument("The JIT is only supported on x86-64");
+#endif
+    }
+    _enabled = enabled;
+    clear();
+}
+
+uint32_t Jit::run(uint64_t until) {
+    CPU& cpu = _cpu;
+    if (cpu._halted || cpu.halt_bug || cpu._ime_enable_next_cycle) {
+        return 0;
+    }
+    if (cpu._ime_flag && cpu._pending_interrupts) {
+        // Interrupt dispatch is left to the interpreter
+        return 0;
+    }
+
+    uint16_t address = cpu.registers.pc;
+    const uint8_t* code = gb.code_pointer(address);
+    if (!code) {
+        return 0;
+    }
+
+    if (_code_used + (MAX_BLOCK_LENGTH + 2) * MAX_INSTRUCTION_SIZE > CODE_BUFFER_SIZE) {
+        // Out of space, start over. Nothing is running at this point.
+        clear();
+        stats.flushes++;
+    }
+
+    std::unique_ptr<JitPage>& page = _pages[(uintptr_t) code - (address & 0xFF)];
+    if (!page) {
+        page.reset(new JitPage());
+        gb.protect_code(address);
+    }
+
+    uint8_t offset = address & 0xFF;
+    BlockFunction& block = page->blocks[offset];
+    if (!block) {
+        if (++page->heat[offset] < HOT_THRESHOLD) {
+            return 0;
+        }
+        page->heat[offset] = 0;
+        block = compile(address, code);
+        if (!block) {
+            return 0;
+        }
+    }
+
+    _until = until;
+    cpu._block_exit_requested = 0;
+    uint32_t instructions = block();
+    stats.block_runs++;
+    stats.instructions += instructions;
+    return instructions;
+}
+
+void Jit::invalidate(uint16_t address, const uint8_t* code) {
+    // Pages are dropped, but their code stays in the buffer until it fills up, so a
+    // block that just overwrote itself can still return.
+    _pages.erase((uintptr_t) code - (address & 0xFF));
+    _cpu.request_block_exit();
+}
+
+void Jit::clear() {
+    _pages.clear();
+    _code_used = 0;
+    _cpu.request_block_exit();
+}
+
+Jit::BlockFunction Jit::compile(uint16_t address, const uint8_t* code) {
+    CPU& cpu = _cpu;
+    Registers& registers = cpu.registers;
+    auto disp = [&cpu](const void* field) {
+        return (int32_t) ((intptr_t) field - (intptr_t) &cpu);
+    };
+    uint8_t* byte_registers[8] = { &registers.b, &registers.c, &registers.d, &registers.e, &registers.h, &registers.l, nullptr, &registers.a };
+    uint8_t* pair_registers[3][2] = { { &registers.b, &registers.c }, { &registers.d, &registers.e }, { &registers.h, &registers.l } };
+
+    uint8_t* start = _code + _code_used;
+    Emitter e(start);
+    std::vector<std::pair<size_t, uint32_t>> exits; // Jump to patch, instructions run so far
+
+    // push rbx; (sub rsp, 32); mov rbx, &cpu
+    e.byte(0x53);
+#ifdef _WIN32
+    e.byte(0x48); e.byte(0x83); e.byte(0xEC); e.byte(0x20);
+#endif
+    e.byte(0x48); e.byte(0xBB); e.qword((uint64_t) (uintptr_t) &cpu);
+
+    size_t page_remaining = 0x100 - (address & 0xFF);
+    size_t offset = 0;
+    uint32_t count = 0;
+    bool called_handler = false;
+    while (count < MAX_BLOCK_LENGTH) {
+        uint8_t opcode = code[offset];
+        if (offset + CPU::instruction_length(opcode) > page_remaining || !CPU::valid_opcode(opcode)) {
+            break;
+        }
+
+        DecodedInstruction instruction;
+        CPU::decode(code + offset, instruction);
+
+        if (count > 0) {
+            // Leave if the interpreter loop has something to do before this instruction.
+            // mov rax, [cycles]; cmp rax, [until]; jae; cmp rax, [next deadline]; jae
+            e.byte(0x48); e.byte(0x8B); e.rbx_operand(RAX, disp(&gb.cycles));
+            e.byte(0x48); e.byte(0x3B); e.rbx_operand(RAX, disp(&_until));
+            exits.push_back({ e.jump(JAE), count });
+            e.byte(0x48); e.byte(0x3B); e.rbx_operand(RAX, disp(&gb._scheduler._next_deadline));
+            exits.push_back({ e.jump(JAE), count });
+
+            if (called_handler) {
+                // Only handlers can touch memory, IO and the interrupt state.
+                // cmp byte [exit requested], 0; jne
+                e.byte(0x80); e.rbx_operand(7, disp(&cpu._block_exit_requested)); e.byte(0);
+                exits.push_back({ e.jump(JNE), count });
+                // cmp byte [ime enable next cycle], 0; jne
+                e.byte(0x80); e.rbx_operand(7, disp(&cpu._ime_enable_next_cycle)); e.byte(0);
+                exits.push_back({ e.jump(JNE), count });
+                // cmp byte [ime], 0; je skip; cmp byte [pending interrupts], 0; jne
+                e.byte(0x80); e.rbx_operand(7, disp(&cpu._ime_flag)); e.byte(0);
+                e.byte(0x74); size_t skip = e.position(); e.byte(0);
+                e.byte(0x80); e.rbx_operand(7, disp(&cpu._pending_interrupts)); e.byte(0);
+                exits.push_back({ e.jump(JNE), count });
+                start[skip] = (uint8_t) (e.position() - (skip + 1));
+            }
+        }
+
+        uint8_t x = opcode >> 6;
+        uint8_t y = (opcode >> 3) & 0b111;
+        uint8_t z = opcode & 0b111;
+        uint16_t immediate = (((uint16_t) instruction.operands[1]) << 8) | instruction.operands[0];
+        bool inlined = true;
+        bool advance_pc = true;
+
+        if (opcode == 0x00) {
+            // NOP
+
+        } else if (x == 1 && y != 6 && z != 6) {
+            // LD r, r': mov al, [source]; mov [target], al
+            e.byte(0x8A); e.rbx_operand(RAX, disp(byte_registers[z]));
+            e.byte(0x88); e.rbx_operand(RAX, disp(byte_registers[y]));
+
+        } else if (x == 0 && z == 6 && y != 6) {
+            // LD r, n: mov byte [target], n
+            e.byte(0xC6); e.rbx_operand(0, disp(byte_registers[y])); e.byte(instruction.operands[0]);
+
+        } else if (x == 0 && z == 1 && (y & 1) == 0) {
+            // LD rr, nn
+            uint8_t p = y >> 1;
+            if (p == 3) {
+                // mov word [sp], nn
+                e.byte(0x66); e.byte(0xC7); e.rbx_operand(0, disp(&registers.sp)); e.word(immediate);
+            } else {
+                // mov byte [high], n; mov byte [low], n
+                e.byte(0xC6); e.rbx_operand(0, disp(pair_registers[p][0])); e.byte(instruction.operands[1]);
+                e.byte(0xC6); e.rbx_operand(0, disp(pair_registers[p][1])); e.byte(instruction.operands[0]);
+            }
+
+        } else if (x == 0 && z == 3) {
+            // INC rr / DEC rr
+            uint8_t p = y >> 1;
+            uint8_t extension = (y & 1) ? 1 : 0;
+            if (p == 3) {
+                // inc/dec word [sp]
+                e.byte(0x66); e.byte(0xFF); e.rbx_operand(extension, disp(&registers.sp));
+            } else {
+                // mov ah, [high]; mov al, [low]; inc/dec ax; mov [low], al; mov [high], ah
+                e.byte(0x8A); e.rbx_operand(AH, disp(pair_registers[p][0]));
+                e.byte(0x8A); e.rbx_operand(RAX, disp(pair_registers[p][1]));
+                e.byte(0x66); e.byte(0xFF); e.byte(0xC0 | (extension << 3));
+                e.byte(0x88); e.rbx_operand(RAX, disp(pair_registers[p][1]));
+                e.byte(0x88); e.rbx_operand(AH, disp(pair_registers[p][0]));
+            }
+
+        } else if (opcode == 0xC3) {
+            // JP nn: mov word [pc], nn
+            e.byte(0x66); e.byte(0xC7); e.rbx_operand(0, disp(&registers.pc)); e.word(immediate);
+            advance_pc = false;
+
+        } else if (opcode == 0x18) {
+            // JR e: add word [pc], 2 + e
+            e.byte(0x66); e.byte(0x81); e.rbx_operand(0, disp(&registers.pc));
+            e.word((uint16_t) (instruction.length + (int8_t) instruction.operands[0]));
+            advance_pc = false;
+
+        } else if (opcode == 0xF3) {
+            // DI: mov byte [ime], 0; mov byte [ime enable next cycle], 0
+            e.byte(0xC6); e.rbx_operand(0, disp(&cpu._ime_flag)); e.byte(0);
+            e.byte(0xC6); e.rbx_operand(0, disp(&cpu._ime_enable_next_cycle)); e.byte(0);
+
+        } else {
+            inlined = false;
+        }
+
+        if (inlined) {
+            if (advance_pc) {
+                // add word [pc], length
+                e.byte(0x66); e.byte(0x81); e.rbx_operand(0, disp(&registers.pc)); e.word(instruction.length);
+            }
+            // add qword [cycles], cycles * 4
+            e.byte(0x48); e.byte(0x81); e.rbx_operand(0, disp(&gb.cycles)); e.dword(instruction.cycles * 4);
+
+        } else {
+            // add word [pc], length
+            e.byte(0x66); e.byte(0x81); e.rbx_operand(0, disp(&registers.pc)); e.word(instruction.length);
+            if (instruction.length > 1) {
+                // mov word [operands], immediate
+                e.byte(0x66); e.byte(0xC7); e.rbx_operand(0, disp(cpu._operands)); e.word(immediate);
+            }
+#ifdef _WIN32
+            e.byte(0x48); e.byte(0x89); e.byte(0xD9); // mov rcx, rbx
+#else
+            e.byte(0x48); e.byte(0x89); e.byte(0xDF); // mov rdi, rbx
+#endif
+            // mov rax, handler; call rax
+            e.byte(0x48); e.byte(0xB8); e.qword((uint64_t) (uintptr_t) instruction.handler);
+            e.byte(0xFF); e.byte(0xD0);
+            // movzx eax, al; shl eax, 2; add [cycles], rax
+            e.byte(0x0F); e.byte(0xB6); e.byte(0xC0);
+            e.byte(0xC1); e.byte(0xE0); e.byte(0x02);
+            e.byte(0x48); e.byte(0x01); e.rbx_operand(RAX, disp(&gb.cycles));
+        }
+        called_handler = !inlined;
+
+        offset += instruction.length;
+        count++;
+        if (CPU::ends_block(opcode)) {
+            break;
+        }
+    }
+
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // mov eax, count; epilogue: (add rsp, 32); pop rbx; ret
+    e.byte(0xB8); e.dword(count);
+    size_t epilogue = e.position();
+#ifdef _WIN32
+    e.byte(0x48); e.byte(0x83); e.byte(0xC4); e.byte(0x20);
+#endif
+    e.byte(0x5B);
+    e.byte(0xC3);
+
+    for (const std::pair<size_t, uint32_t>& exit : exits) {
+        // mov eax, instructions run; jmp epilogue
+        e.patch(exit.first, e.position());
+        e.byte(0xB8); e.dword(exit.second);
+        e.byte(0xE9); e.dword(0);
+        e.patch(e.position() - 4, epilogue);
+    }
+
+    _code_used += e.size();
+    stats.blocks_compiled++;
+    return (BlockFunction) start;
+}
\ No newline at end of file
@@ -3,15 +3,15 @@
 #include "gbsystem.h"
 #include "utils.h"
 
-uint8_t inputs = 0xFF;
-
 Joypad::Joypad(GBSystem& gb) :
     GBComponent::GBComponent(gb)
 {
     gb.add_register_callbacks(this, {JOYP});
 }
 
-void Joypad::tick() {
+void Joypad::sync(uint64_t cycle) {
+    // Inputs only need to be polled whenever the rest of the system is caught up.
+    _sync_cycle = cycle + 1;
     update_joypad();
 }
 
@@ -39,10 +39,10 @@ void Joypad::update_joypad() {
 
     _current_register |= 0x0F;
     if (_selected_dpad) {
-        _current_register &= inputs & 0xF;
+        _current_register &= _inputs & 0xF;
     }
     if (_selected_buttons) {
-        _current_register &= (inputs >> 4) & 0xF;
+        _current_register &= (_inputs >> 4) & 0xF;
     }
 
     bool any_button_pressed = false;
@@ -55,4 +55,19 @@ void Joypad::update_joypad() {
         // Interrupt!
         gb.request_interrupt(Interrupts::Joypad);
     }
+}
+
+// The held buttons are left alone, those are owned by the frontend.
+void Joypad::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(_current_register);
+    state.write(_selected_dpad);
+    state.write(_selected_buttons);
+}
+
+void Joypad::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(_current_register);
+    state.read(_selected_dpad);
+    state.read(_selected_buttons);
 }
\ No newline at end of file
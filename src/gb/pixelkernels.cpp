@@ -0,0 +1,198 @@
+#include "pixelkernels.h"
+
+#ifdef SCGBE_PIXEL_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void decode_row_scalar(uint8_t lsb, uint8_t msb, uint8_t* out) {
+    for (int x = 0; x < 8; x++) {
+        uint8_t bit = 7 - x;
+        out[x] = (((msb >> bit) & 1) << 1) | ((lsb >> bit) & 1);
+    }
+}
+
+void map_palette_scalar(const uint8_t* indices, const uint8_t* palette, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = palette[indices[i]];
+    }
+}
+
+void composite_scalar(const uint8_t* bg, const uint8_t* sprites, const uint8_t* bg_palette, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t sprite = sprites[i];
+        bool hidden = (sprite & SPRITE_PIXEL_BEHIND_BG) && bg[i] != 0;
+        out[i] = ((sprite & SPRITE_PIXEL_OPAQUE) && !hidden) ? (sprite & 0b11) : bg_palette[bg[i]];
+    }
+}
+
+void map_rgba32_scalar(const uint8_t* shades, const uint32_t* lut, uint32_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = lut[shades[i]];
+    }
+}
+
+void map_rgb565_scalar(const uint8_t* shades, const uint16_t* lut, uint16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = lut[shades[i]];
+    }
+}
+
+#ifdef SCGBE_PIXEL_SIMD_X86
+
+// SSE2 is part of x86-64, AVX2 is only used once the CPU says it has it. The AVX2
+// versions finish with the scalar loop, calling into the SSE2 ones from there costs
+// an AVX/SSE transition that is slower than the tail itself.
+
+__attribute__((target("sse2")))
+void decode_row_sse2(uint8_t lsb, uint8_t msb, uint8_t* out) {
+    const __m128i bits = _mm_setr_epi8((char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i low = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8((char) lsb), bits), bits);
+    __m128i high = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8((char) msb), bits), bits);
+    __m128i pixels = _mm_or_si128(_mm_and_si128(low, _mm_set1_epi8(1)), _mm_and_si128(high, _mm_set1_epi8(2)));
+    _mm_storel_epi64((__m128i*) out, pixels);
+}
+
+// No byte shuffle in SSE2, so each palette entry is selected with a compare.
+__attribute__((target("sse2")))
+inline __m128i palette_lookup_sse2(__m128i indices, const uint8_t* palette) {
+    __m128i result = _mm_and_si128(_mm_cmpeq_epi8(indices, _mm_setzero_si128()), _mm_set1_epi8((char) palette[0]));
+    for (int i = 1; i < 4; i++) {
+        __m128i selected = _mm_cmpeq_epi8(indices, _mm_set1_epi8((char) i));
+        result = _mm_or_si128(result, _mm_and_si128(selected, _mm_set1_epi8((char) palette[i])));
+    }
+    return result;
+}
+
+__attribute__((target("sse2")))
+void map_palette_sse2(const uint8_t* indices, const uint8_t* palette, uint8_t* out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i mapped = palette_lookup_sse2(_mm_loadu_si128((const __m128i*) (indices + i)), palette);
+        _mm_storeu_si128((__m128i*) (out + i), mapped);
+    }
+    map_palette_scalar(indices + i, palette, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void composite_sse2(const uint8_t* bg, const uint8_t* sprites, const uint8_t* bg_palette, uint8_t* out, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i behind_bit = _mm_set1_epi8((char) SPRITE_PIXEL_BEHIND_BG);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i indices = _mm_loadu_si128((const __m128i*) (bg + i));
+        __m128i sprite = _mm_loadu_si128((const __m128i*) (sprites + i));
+
+        __m128i opaque = _mm_cmplt_epi8(sprite, zero); // SPRITE_PIXEL_OPAQUE is the sign bit
+        __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(sprite, behind_bit), behind_bit);
+        __m128i hidden = _mm_andnot_si128(_mm_cmpeq_epi8(indices, zero), behind);
+        __m128i use_sprite = _mm_andnot_si128(hidden, opaque);
+
+        __m128i sprite_color = _mm_and_si128(sprite, _mm_set1_epi8(0b11));
+        __m128i bg_color = palette_lookup_sse2(indices, bg_palette);
+        __m128i result = _mm_or_si128(_mm_and_si128(use_sprite, sprite_color), _mm_andnot_si128(use_sprite, bg_color));
+        _mm_storeu_si128((__m128i*) (out + i), result);
+    }
+    composite_scalar(bg + i, sprites + i, bg_palette, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i palette_table_avx2(const uint8_t* palette) {
+    // Indices are 0-3, so a byte shuffle within each 128 bit lane does the lookup
+    __m128i table = _mm_setr_epi8((char) palette[0], (char) palette[1], (char) palette[2], (char) palette[3],
+                                  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    return _mm256_broadcastsi128_si256(table);
+}
+
+__attribute__((target("avx2")))
+void map_palette_avx2(const uint8_t* indices, const uint8_t* palette, uint8_t* out, size_t count) {
+    __m256i table = palette_table_avx2(palette);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i mapped = _mm256_shuffle_epi8(table, _mm256_loadu_si256((const __m256i*) (indices + i)));
+        _mm256_storeu_si256((__m256i*) (out + i), mapped);
+    }
+    map_palette_scalar(indices + i, palette, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void composite_avx2(const uint8_t* bg, const uint8_t* sprites, const uint8_t* bg_palette, uint8_t* out, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i behind_bit = _mm256_set1_epi8((char) SPRITE_PIXEL_BEHIND_BG);
+    __m256i table = palette_table_avx2(bg_palette);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i indices = _mm256_loadu_si256((const __m256i*) (bg + i));
+        __m256i sprite = _mm256_loadu_si256((const __m256i*) (sprites + i));
+
+        __m256i opaque = _mm256_cmpgt_epi8(zero, sprite);
+        __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, behind_bit), behind_bit);
+        __m256i hidden = _mm256_andnot_si256(_mm256_cmpeq_epi8(indices, zero), behind);
+        __m256i use_sprite = _mm256_andnot_si256(hidden, opaque);
+
+        __m256i sprite_color = _mm256_and_si256(sprite, _mm256_set1_epi8(0b11));
+        __m256i bg_color = _mm256_shuffle_epi8(table, indices);
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_blendv_epi8(bg_color, sprite_color, use_sprite));
+    }
+    composite_scalar(bg + i, sprites + i, bg_palette, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void map_rgba32_avx2(const uint8_t* shades, const uint32_t* lut, uint32_t* out, size_t count) {
+    __m256i table = _mm256_setr_epi32(lut[0], lut[1], lut[2], lut[3], lut[0], lut[1], lut[2], lut[3]);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (shades + i)));
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_permutevar8x32_epi32(table, indices));
+    }
+    map_rgba32_scalar(shades + i, lut, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void map_rgb565_avx2(const uint8_t* shades, const uint16_t* lut, uint16_t* out, size_t count) {
+    // Byte shuffle again, picking both bytes of the entry: shade n becomes bytes 2n, 2n + 1
+    __m128i entries = _mm_setr_epi16(lut[0], lut[1], lut[2], lut[3], 0, 0, 0, 0);
+    __m256i table = _mm256_broadcastsi128_si256(entries);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i indices = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (shades + i)));
+        __m256i bytes = _mm256_add_epi16(_mm256_mullo_epi16(indices, _mm256_set1_epi16(0x0202)), _mm256_set1_epi16(0x0100));
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_shuffle_epi8(table, bytes));
+    }
+    map_rgb565_scalar(shades + i, lut, out + i, count - i);
+}
+
+// Without a shuffle, selecting the output pixels with SSE2 compares came out slower than
+// the scalar table lookup.
+const PixelKernels sse2_kernels = { "sse2", decode_row_sse2, map_palette_sse2, composite_sse2, map_rgba32_scalar, map_rgb565_scalar };
+const PixelKernels avx2_kernels = { "avx2", decode_row_sse2, map_palette_avx2, composite_avx2, map_rgba32_avx2, map_rgb565_avx2 };
+
+#endif
+
+const PixelKernels scalar_kernels = { "scalar", decode_row_scalar, map_palette_scalar, composite_scalar, map_rgba32_scalar, map_rgb565_scalar };
+
+}
+
+const PixelKernels& PixelKernels::scalar() {
+    return scalar_kernels;
+}
+
+const PixelKernels& PixelKernels::best() {
+    static const PixelKernels& kernels = *available().back();
+    return kernels;
+}
+
+std::vector<const PixelKernels*> PixelKernels::available() {
+    std::vector<const PixelKernels*> kernels = { &scalar_kernels };
+#ifdef SCGBE_PIXEL_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back(&sse2_kernels);
+        if (__builtin_cpu_supports("avx2")) {
+            kernels.push_back(&avx2_kernels);
+        }
+    }
+#endif
+    return kernels;
+}
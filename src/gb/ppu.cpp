@@ -1,5 +1,8 @@
 #include "ppu.h"
 #include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
 #include "gbsystem.h"
 #include "registers.h"
 #include "utils.h"
@@ -8,7 +11,7 @@ PPU::PPU(GBSystem& gb) :
     GBComponent::GBComponent(gb)
 {
     gb.add_register_callbacks(this, {LY, LYC, STAT, LCDC, SCY, SCX, BGP, OBP0, OBP1, WY, WX});
-    _scanline_sprite_buffer.reserve(10);
+    _scanline_sprite_buffer.reserve(OAM_SIZE / sizeof(OAMEntry));
 
     // 0 the framebuffer
     std::fill(std::begin(framebuffer), std::end(framebuffer), 0);
@@ -18,6 +21,109 @@ bool oam_entry_pointer_sort(OAMEntry* a, OAMEntry* b) {
     return a->x_position < b->x_position;
 }
 
+void PPU::sync(uint64_t cycle) {
+    while (_sync_cycle <= cycle) {
+        uint64_t remaining = cycle + 1 - _sync_cycle;
+
+        if (!enabled()) {
+            // Nothing happens while the LCD is off.
+            _was_disabled = true;
+            _sync_cycle += remaining;
+            break;
+        }
+
+        if (_was_disabled) {
+            // Idle until the start of the next frame.
+            uint32_t frame_offset = _sync_cycle % gb.cycles_per_frame();
+            if (frame_offset != 0) {
+                _sync_cycle += std::min((uint64_t) (gb.cycles_per_frame() - frame_offset), remaining);
+            } else {
+                tick();
+                _sync_cycle++;
+            }
+            continue;
+        }
+
+        // Outside of mode 3, most dots only count up. Skip straight to the next one that does something,
+        // as long as there is no pending STAT line change in between.
+        uint16_t next_active_dot = 0;
+        switch (_mode) {
+        case LCDDrawMode::HBlank:
+        case LCDDrawMode::VBlank: next_active_dot = DOTS_PER_SCANLINE - 1; break;
+        case LCDDrawMode::OAM_Scan: next_active_dot = (_dots == 0) ? 0 : OAM_SCAN_DOTS; break;
+        case LCDDrawMode::Drawing:
+            // Dots spent in a penalty only count it down, once its checks have run
+            next_active_dot = _penalties_checked ? std::min<uint16_t>(_dots + _penalty_dots, DOTS_PER_SCANLINE - 1) : 0;
+            break;
+        }
+        if (_dots < next_active_dot && _stat_blocking == compare_interrupt_line()) {
+            uint16_t skipped_dots = std::min((uint64_t) (next_active_dot - _dots), remaining);
+            _dots += skipped_dots;
+            _sync_cycle += skipped_dots;
+            if (_mode == LCDDrawMode::Drawing) {
+                _penalty_dots -= skipped_dots;
+            }
+            continue;
+        }
+
+        tick();
+        _sync_cycle++;
+    }
+
+    schedule_next_event();
+}
+
+void PPU::reset_sync_cycle() {
+    GBComponent::reset_sync_cycle();
+    schedule_next_event();
+}
+
+void PPU::schedule_next_event() {
+    // Every mode or LCDC change ends up here, so VRAM access is kept up to date too.
+    update_vram_access();
+
+    if (!enabled()) {
+        gb.scheduler().cancel(SchedulerEvent::PPU);
+        return;
+    }
+
+    if (_was_disabled) {
+        uint32_t frame_offset = _sync_cycle % gb.cycles_per_frame();
+        uint64_t frame_start = _sync_cycle + (frame_offset ? gb.cycles_per_frame() - frame_offset : 0);
+        gb.scheduler().schedule(SchedulerEvent::PPU, frame_start);
+        return;
+    }
+
+    if (_stat_blocking != compare_interrupt_line()) {
+        // The STAT line changes on the very next dot.
+        gb.scheduler().schedule(SchedulerEvent::PPU, _sync_cycle);
+        return;
+    }
+
+    // The dot at which the next mode change (or scanline change) happens.
+    uint16_t remaining_dots = 0;
+    switch (_mode) {
+    case LCDDrawMode::HBlank:
+    case LCDDrawMode::VBlank: remaining_dots = (DOTS_PER_SCANLINE - 1) - _dots; break;
+    case LCDDrawMode::OAM_Scan: remaining_dots = OAM_SCAN_DOTS - _dots; break;
+    case LCDDrawMode::Drawing: {
+        // Can't know the length of mode 3 ahead of time; wake up when it could end at the earliest.
+        remaining_dots = (SCREEN_W - _draw_pixel_x) - 1 + _penalty_dots;
+        remaining_dots = std::min<uint16_t>(remaining_dots, (DOTS_PER_SCANLINE - 1) - _dots);
+        break;
+    }
+    }
+    gb.scheduler().schedule(SchedulerEvent::PPU, _sync_cycle + remaining_dots);
+}
+
+void PPU::update_vram_access() {
+    bool accessible = !(enabled() && mode() == LCDDrawMode::Drawing);
+    if (accessible != _vram_accessible) {
+        _vram_accessible = accessible;
+        gb.update_memory_map(VRAM_START, VRAM_START + VRAM_SIZE - 1);
+    }
+}
+
 void PPU::tick() {
 
     if (!enabled()) {
@@ -28,7 +134,7 @@ void PPU::tick() {
     if (_was_disabled) {
         // Recovering from being disabled.
         // Wait until the next frame to reset everything (TODO: is this accurate?)
-        if (gb.frame_cycles == 0) {
+        if ((_sync_cycle % gb.cycles_per_frame()) == 0) {
             // Next scanline
             _dots = 0;
             _draw_pixel_x = 0;
@@ -37,6 +143,7 @@ void PPU::tick() {
             _window_scanline = 0;
             _mode = LCDDrawMode::OAM_Scan;
             _was_disabled = false;
+            start_frame();
         } else {
             return;
         }
@@ -77,6 +184,11 @@ void PPU::tick() {
             for (size_t i = 0; i < MAX_SPRITES_PER_SCANLINE; i++) {
                 _scanline_sprite_penalties[i] = false;
             }
+            if (_render_frame) {
+                build_sprite_row();
+            } else {
+                _sprite_row_valid = false;
+            }
 
             _mode = LCDDrawMode::Drawing;
         }
@@ -106,10 +218,11 @@ void PPU::tick() {
         if (_dots == OAM_SCAN_DOTS) {
             _penalty_dots = 12; // 12 wasted cycles at the beginning
             _penalty_dots += (_bg_scroll_x % 8); // Discarding pixels in leftmost tile
+            // Skipped frames take the fast path, which then draws nothing
+            _scanline_deferred = _scanline_rendering || !_render_frame;
         }
 
         // if statement only runs in DMG mode.
-        std::vector<OAMEntry*> sprites_to_draw;
         if (_obj_enabled && !gb.cgb_mode()) {
             for (size_t i = 0; i < std::min(_scanline_sprite_buffer.size(), (size_t) MAX_SPRITES_PER_SCANLINE); i++) {
                 OAMEntry* entry = _scanline_sprite_buffer[i];
@@ -132,13 +245,6 @@ void PPU::tick() {
                     }
                     _scanline_sprite_penalties[i] = true;
                 }
-
-                if (x_diff >= 8) {
-                    continue;
-                }
-
-                // Draw this sprite!
-                sprites_to_draw.push_back(entry);
             }
         }
 
@@ -148,48 +254,25 @@ void PPU::tick() {
             _window_penalty = true;
         }
 
+        _penalties_checked = true;
         if (_penalty_dots) {
             // Don't draw right now, in a penalty
             _penalty_dots--;
+        } else if (_scanline_deferred) {
+            if (++_draw_pixel_x == SCREEN_W) {
+                if (_render_frame) {
+                    render_pixels(0, SCREEN_W);
+                    stats.fast_lines++;
+                }
+                _scanline_deferred = false;
+                end_drawing();
+            }
         } else {
             // Draw!
             int framebuffer_index = ((int) _draw_pixel_x) + ((int) _current_scanline) * SCREEN_W;
 
             // Sprites:
-            OAMEntry* drew_sprite = nullptr;
-            if (_obj_enabled) {
-                for (OAMEntry* sprite : sprites_to_draw) {
-                    uint8_t x_diff = (_draw_pixel_x + 16) - sprite->x_position;
-                    uint8_t y_diff = (_current_scanline + 16) - sprite->y_position;
-                    uint8_t tile_index = sprite->tile_index;
-                    if (_obj_tall) {
-                        if (y_diff > 7 ^ sprite->y_flip()) {
-                            tile_index |= 0x01;
-                        } else {
-                            tile_index &= 0xFE;
-                        }
-                    }
-
-                    uint8_t draw_pixel_of_sprite_x = x_diff % 8;
-                    if (sprite->x_flip()) {
-                        draw_pixel_of_sprite_x = 7 - draw_pixel_of_sprite_x;
-                    }
-                    uint8_t draw_pixel_of_sprite_y = y_diff % 8;
-                    if (sprite->y_flip()) {
-                        draw_pixel_of_sprite_y = 7 - draw_pixel_of_sprite_y;
-                    }
-
-                    uint16_t offset = tile_index;
-                    uint16_t sprite_tile_addr = TILE_BLOCK0_ADDR + (offset * 0x10);
-                    uint8_t pixel_value = get_pixel_of_tile(sprite_tile_addr, draw_pixel_of_sprite_x, draw_pixel_of_sprite_y);
-
-                    if (pixel_value != 0) {
-                        framebuffer[framebuffer_index] = _obj_palettes[sprite->dmg_palette()][pixel_value];
-                        drew_sprite = sprite;
-                        break;
-                    }
-                }
-            }
+            uint8_t sprite_pixel = sprite_row()[_draw_pixel_x];
 
             // TODO: window bugs (scx==0, stuff like that.)
             uint8_t draw_pixel_value = 0;
@@ -227,15 +310,16 @@ void PPU::tick() {
                     draw_pixel_value = get_pixel_of_tile(bg_tile_addr, draw_pixel_of_bg_tile_x, draw_pixel_of_bg_tile_y);
                 }
             }
-            if (!drew_sprite || (drew_sprite->priority() && draw_pixel_value != 0)) {
+            bool sprite_hidden = (sprite_pixel & SPRITE_PIXEL_BEHIND_BG) && draw_pixel_value != 0;
+            if ((sprite_pixel & SPRITE_PIXEL_OPAQUE) && !sprite_hidden) {
+                framebuffer[framebuffer_index] = sprite_pixel & 0b11;
+            } else {
                 framebuffer[framebuffer_index] = _bg_palette[draw_pixel_value];
             }
 
             if (++_draw_pixel_x == SCREEN_W) {
-                // Done drawing
-                _mode = LCDDrawMode::HBlank;
-                _last_drawn_sprite_tile_x = -1;
-                _window_penalty = false;
+                stats.slow_lines++;
+                end_drawing();
             }
         }
     }
@@ -252,6 +336,9 @@ void PPU::tick() {
             // Entering VBlank
             _mode = LCDDrawMode::VBlank;
             gb.request_interrupt(Interrupts::VBlank);
+            if (_frame_exchange && _render_frame) {
+                _frame_exchange->publish(_output_frame.empty() ? framebuffer : _output_frame.data());
+            }
 
         } else if (_mode == LCDDrawMode::HBlank) {
             // Back to OAM
@@ -263,6 +350,7 @@ void PPU::tick() {
             _drawing_window = false;
             _window_scanline = 0;
             _mode = LCDDrawMode::OAM_Scan;
+            start_frame();
         }
     }
 
@@ -274,13 +362,202 @@ void PPU::tick() {
     _stat_blocking = trigger_interrupt;
 }
 
-uint8_t PPU::get_pixel_of_tile(uint16_t tile_addr, uint8_t x, uint8_t y) {
-    tile_addr += (y * 2);
-    uint8_t graphics_lsb = read_address(tile_addr, true);
-    uint8_t graphics_msb = read_address(tile_addr + 1, true);
+void PPU::end_drawing() {
+    if (_render_frame && _output_format != OutputFormat::None) {
+        output_lines(_current_scanline, _current_scanline + 1);
+    }
+    _mode = LCDDrawMode::HBlank;
+    _last_drawn_sprite_tile_x = -1;
+    _window_penalty = false;
+    _penalties_checked = false;
+}
+
+void PPU::set_pixel_kernels(const PixelKernels& kernels) {
+    _pixel_kernels = &kernels;
+    _tiles.set_kernels(kernels);
+}
+
+void PPU::set_scanline_rendering(bool enabled) {
+    before_render_state_change();
+    _scanline_rendering = enabled;
+}
+
+void PPU::set_output_format(OutputFormat::OutputFormat format) {
+    size_t pixel_size = 0;
+    switch (format) {
+    case OutputFormat::None: pixel_size = 0; break;
+    case OutputFormat::RGBA8888: pixel_size = sizeof(uint32_t); break;
+    case OutputFormat::RGB565: pixel_size = sizeof(uint16_t); break;
+    default: throw std::invalid_argument("Unknown output format");
+    }
+    size_t frame_size = pixel_size ? SCREEN_W * SCREEN_H * pixel_size : sizeof(framebuffer);
+    if (_frame_exchange && _frame_exchange->frame_size() != frame_size) {
+        throw std::invalid_argument("Output format doesn't match the frame exchange");
+    }
+
+    _output_format = format;
+    _output_frame.assign(SCREEN_W * SCREEN_H * pixel_size, 0);
+    set_output_palette(_output_palette);
+}
+
+void PPU::set_output_palette(const uint32_t (&colors)[4]) {
+    for (int shade = 0; shade < 4; shade++) {
+        uint32_t color = colors[shade] & 0xFFFFFF;
+        _output_palette[shade] = color;
+
+        uint8_t red = color >> 16;
+        uint8_t green = color >> 8;
+        uint8_t blue = color;
+        uint8_t rgba[4] = { red, green, blue, 0xFF };
+        std::memcpy(&_output_lut32[shade], rgba, sizeof(rgba));
+        _output_lut16[shade] = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+    }
+    output_lines(0, SCREEN_H);
+}
+
+void PPU::set_frame_exchange(FrameExchange* exchange) {
+    if (exchange && exchange->frame_size() != published_frame_size()) {
+        throw std::invalid_argument("Frame exchange size doesn't match the PPU's output");
+    }
+    _frame_exchange = exchange;
+}
+
+size_t PPU::published_frame_size() const {
+    return _output_frame.empty() ? sizeof(framebuffer) : _output_frame.size();
+}
+
+void PPU::output_lines(uint8_t first_line, uint8_t end_line) {
+    const uint8_t* shades = framebuffer + (first_line * SCREEN_W);
+    size_t count = (end_line - first_line) * SCREEN_W;
+    switch (_output_format) {
+    case OutputFormat::None: break;
+    case OutputFormat::RGBA8888:
+        _pixel_kernels->map_rgba32(shades, _output_lut32, (uint32_t*) _output_frame.data() + (first_line * SCREEN_W), count);
+        break;
+    case OutputFormat::RGB565:
+        _pixel_kernels->map_rgb565(shades, _output_lut16, (uint16_t*) _output_frame.data() + (first_line * SCREEN_W), count);
+        break;
+    }
+}
+
+void PPU::set_frame_skip(uint32_t frames) {
+    _frame_skip = frames;
+    _frames_until_render = 0;
+}
+
+void PPU::set_rendering(bool enabled) {
+    _rendering = enabled;
+}
+
+void PPU::start_frame() {
+    _render_frame = _rendering && _frames_until_render == 0;
+    if (_render_frame) {
+        _frames_until_render = _frame_skip;
+        stats.rendered_frames++;
+    } else {
+        if (_rendering) {
+            _frames_until_render--;
+        }
+        stats.skipped_frames++;
+    }
+}
+
+void PPU::before_render_state_change() {
+    _penalties_checked = false;
+    if (_scanline_deferred && _render_frame) {
+        // Catch up with what the dot-accurate path would have drawn by now, and let it
+        // take over for the rest of the line.
+        render_pixels(0, _draw_pixel_x);
+        _scanline_deferred = false;
+    }
+    _sprite_row_valid = false;
+}
+
+void PPU::render_pixels(uint8_t start_x, uint8_t end_x) {
+    if (start_x >= end_x) {
+        return;
+    }
 
-    uint8_t tile_pixel_mask = 1 << (7 - x);
-    return ((graphics_msb & tile_pixel_mask) != 0) << 1 | ((graphics_lsb & tile_pixel_mask) != 0);
+    // The background color indices are put together, then composited with the sprite row
+    // into the framebuffer in one go.
+    uint8_t bg[SCREEN_W];
+
+    if (_bg_window_enable_priority) {
+        uint8_t bg_y = _current_scanline + _bg_scroll_y;
+        uint16_t bg_tilemap_row = (_bg_tilemap_high ? TILEMAP1_ADDR : TILEMAP0_ADDR) + (bg_y / 8) * 32;
+        uint8_t window_y = _window_scanline - _window_scroll_y;
+        uint16_t window_tilemap_row = (_window_tilemap_high ? TILEMAP1_ADDR : TILEMAP0_ADDR) + (window_y / 8) * 32;
+        int window_start_x = (_window_enabled && _drawing_window) ? _window_scroll_x - 7 : SCREEN_W;
+
+        // One tile (or what's left of it before the window starts) at a time
+        int x = start_x;
+        while (x < end_x) {
+            bool in_window = x >= window_start_x;
+            uint8_t pixel_x = in_window ? (x + 7 - _window_scroll_x) : (x + _bg_scroll_x);
+            uint16_t tilemap_addr = (in_window ? window_tilemap_row : bg_tilemap_row) + (pixel_x / 8);
+            uint8_t row = in_window ? (window_y % 8) : (bg_y % 8);
+            const uint8_t* tile_row = _tiles.row(tile_data_address(read_address(tilemap_addr, true)) - VRAM_START, row);
+
+            int count = std::min(8 - (pixel_x % 8), end_x - x);
+            if (!in_window) {
+                count = std::min(count, window_start_x - x);
+            }
+            std::copy(tile_row + (pixel_x % 8), tile_row + (pixel_x % 8) + count, bg + x);
+            x += count;
+        }
+    } else {
+        std::fill(bg + start_x, bg + end_x, 0);
+    }
+
+    uint8_t* line = framebuffer + ((int) _current_scanline) * SCREEN_W;
+    _pixel_kernels->composite(bg + start_x, sprite_row() + start_x, _bg_palette, line + start_x, end_x - start_x);
+}
+
+void PPU::build_sprite_row() {
+    std::fill(std::begin(_sprite_row), std::end(_sprite_row), 0);
+    if (_obj_enabled && !gb.cgb_mode()) {
+        // In the order the dot-accurate path checks them, the first opaque pixel wins
+        size_t count = std::min(_scanline_sprite_buffer.size(), (size_t) MAX_SPRITES_PER_SCANLINE);
+        for (size_t i = 0; i < count; i++) {
+            const OAMEntry* sprite = _scanline_sprite_buffer[i];
+            uint8_t y_diff = (_current_scanline + 16) - sprite->y_position;
+            uint8_t tile_index = sprite->tile_index;
+            if (_obj_tall) {
+                if (y_diff > 7 ^ sprite->y_flip()) {
+                    tile_index |= 0x01;
+                } else {
+                    tile_index &= 0xFE;
+                }
+            }
+            uint8_t row = y_diff % 8;
+            if (sprite->y_flip()) {
+                row = 7 - row;
+            }
+            const uint8_t* pixels = _tiles.row(tile_index * 0x10, row, sprite->x_flip());
+            const uint8_t* palette = _obj_palettes[sprite->dmg_palette()];
+            uint8_t flags = SPRITE_PIXEL_OPAQUE | (sprite->priority() ? SPRITE_PIXEL_BEHIND_BG : 0);
+
+            for (int pixel = 0; pixel < 8; pixel++) {
+                int x = sprite->x_position - 8 + pixel;
+                if (x >= 0 && x < SCREEN_W && !_sprite_row[x] && pixels[pixel]) {
+                    _sprite_row[x] = flags | palette[pixels[pixel]];
+                }
+            }
+        }
+    }
+
+    _sprite_row_valid = true;
+}
+
+uint16_t PPU::tile_data_address(uint8_t tile_index) const {
+    if (_bg_tile_data_low) {
+        return TILE_BLOCK0_ADDR + (tile_index * 0x10);
+    }
+    return TILE_BLOCK2_ADDR + (((int8_t) tile_index) * 0x10);
+}
+
+uint8_t PPU::get_pixel_of_tile(uint16_t tile_addr, uint8_t x, uint8_t y) {
+    return _tiles.row(tile_addr - VRAM_START, y)[x];
 }
 
 uint8_t PPU::read_address(uint16_t address, bool internal) {
@@ -320,9 +597,11 @@ void PPU::write_address(uint16_t address, uint8_t value, bool internal) {
         }
 
         // TODO: CGB VRAM BANKING
+        before_render_state_change();
         address -= VRAM_START;
         address %= VRAM_SIZE;
         _vram[address] = value;
+        _tiles.invalidate(address);
 
     } else if (address >= OAM_START && address < (OAM_START + OAM_SIZE)) {
         // OAM
@@ -331,6 +610,7 @@ void PPU::write_address(uint16_t address, uint8_t value, bool internal) {
             return;
         }
 
+        before_render_state_change();
         address -= OAM_START;
         _oam[address] = value;
     }
@@ -368,6 +648,7 @@ uint8_t PPU::read_io_register(uint16_t address) {
             _dots = 0;
             _draw_pixel_x = 0;
             _mode = LCDDrawMode::HBlank;
+            schedule_next_event();
         }
         return result;
     }
@@ -408,6 +689,10 @@ uint8_t PPU::read_io_register(uint16_t address) {
 }
 
 void PPU::write_io_register(uint16_t address, uint8_t value) {
+    if (address != LY && address != LYC && address != STAT) {
+        before_render_state_change();
+    }
+
     switch (address) {
     case LY: break;
     case LYC: {
@@ -478,4 +763,106 @@ void PPU::write_io_register(uint16_t address, uint8_t value) {
         break;
     }
     }
+
+    schedule_next_event();
+}
+
+void PPU::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(_current_scanline);
+    state.write(_compare_scanline);
+    state.write(_compare_scanline_interrupt_select);
+    state.write(_mode_interrupt_select);
+    state.write(_stat_blocking);
+    state.write(_enabled);
+    state.write(_window_tilemap_high);
+    state.write(_window_enabled);
+    state.write(_bg_tile_data_low);
+    state.write(_bg_tilemap_high);
+    state.write(_obj_tall);
+    state.write(_obj_enabled);
+    state.write(_bg_window_enable_priority);
+    state.write(_bg_scroll_y);
+    state.write(_bg_scroll_x);
+    state.write(_bg_palette);
+    state.write(_obj_palettes);
+    state.write(_window_scroll_y);
+    state.write(_window_scroll_x);
+
+    state.write(_mode);
+    state.write(_dots);
+    state.write(_penalty_dots);
+    state.write(_draw_pixel_x);
+    state.write(_drawing_window);
+    state.write(_window_scanline);
+
+    // Sprites found during OAM scan are stored as their OAM index
+    state.write((uint8_t) _scanline_sprite_buffer.size());
+    for (OAMEntry* entry : _scanline_sprite_buffer) {
+        state.write((uint8_t) (entry - (OAMEntry*) _oam));
+    }
+    state.write(_scanline_sprite_penalties);
+    state.write(_window_penalty);
+    state.write(_last_drawn_sprite_tile_x);
+    state.write(_was_disabled);
+    state.write(_scanline_deferred);
+
+    state.write_bytes(_vram, VRAM_SIZE * (gb.cgb_mode() ? VRAM_BANKS : 1));
+    state.write(_oam);
+    state.write(framebuffer);
+}
+
+void PPU::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(_current_scanline);
+    state.read(_compare_scanline);
+    state.read(_compare_scanline_interrupt_select);
+    state.read(_mode_interrupt_select);
+    state.read(_stat_blocking);
+    state.read(_enabled);
+    state.read(_window_tilemap_high);
+    state.read(_window_enabled);
+    state.read(_bg_tile_data_low);
+    state.read(_bg_tilemap_high);
+    state.read(_obj_tall);
+    state.read(_obj_enabled);
+    state.read(_bg_window_enable_priority);
+    state.read(_bg_scroll_y);
+    state.read(_bg_scroll_x);
+    state.read(_bg_palette);
+    state.read(_obj_palettes);
+    state.read(_window_scroll_y);
+    state.read(_window_scroll_x);
+
+    state.read(_mode);
+    state.read(_dots);
+    state.read(_penalty_dots);
+    state.read(_draw_pixel_x);
+    state.read(_drawing_window);
+    state.read(_window_scanline);
+
+    uint8_t sprite_count = state.read<uint8_t>();
+    _scanline_sprite_buffer.clear();
+    for (uint8_t i = 0; i < sprite_count; i++) {
+        uint8_t index = state.read<uint8_t>();
+        if (index >= OAM_SIZE / sizeof(OAMEntry)) {
+            throw std::invalid_argument("Save state has an invalid OAM index");
+        }
+        _scanline_sprite_buffer.push_back((OAMEntry*) (_oam + (index * sizeof(OAMEntry))));
+    }
+    state.read(_scanline_sprite_penalties);
+    state.read(_window_penalty);
+    state.read(_last_drawn_sprite_tile_x);
+    state.read(_was_disabled);
+    state.read(_scanline_deferred);
+    _penalties_checked = false;
+    _sprite_row_valid = false;
+
+    state.read_bytes(_vram, VRAM_SIZE * (gb.cgb_mode() ? VRAM_BANKS : 1));
+    _tiles.clear();
+    state.read(_oam);
+    state.read(framebuffer);
+    output_lines(0, SCREEN_H);
+
+    _vram_accessible = !(enabled() && mode() == LCDDrawMode::Drawing);
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "recompiled.h"
+#include <memory>
+#include "gbsystem.h"
+#include "recompiledcontext.h"
+
+namespace {
+
+struct RegisteredModule {
+    const RecompiledModule* module;
+    std::unique_ptr<std::vector<RecompiledCode::Slot>> slots;
+};
+
+// Filled in by static initializers, before main() runs
+std::vector<RegisteredModule>& registered_modules() {
+    static std::vector<RegisteredModule> modules;
+    return modules;
+}
+
+}
+
+uint64_t RecompiledModule::hash_rom(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+RecompiledModuleRegistration::RecompiledModuleRegistration(const RecompiledModule& module) {
+    std::unique_ptr<std::vector<RecompiledCode::Slot>> slots(new std::vector<RecompiledCode::Slot>(module.rom_size));
+    for (size_t i = 0; i < module.entry_count; i++) {
+        const RecompiledEntry& entry = module.entries[i];
+        if (entry.rom_offset < module.rom_size) {
+            (*slots)[entry.rom_offset] = { entry.function, entry.entry };
+        }
+    }
+    registered_modules().push_back({ &module, std::move(slots) });
+}
+
+RecompiledCode::RecompiledCode(GBSystem& gb_param) :
+    gb(gb_param)
+{}
+
+void RecompiledCode::load_rom(const std::vector<uint8_t>& rom) {
+    _module = nullptr;
+    _slots = nullptr;
+
+    std::vector<RegisteredModule>& modules = registered_modules();
+    if (modules.empty()) {
+        return;
+    }
+    uint64_t hash = RecompiledModule::hash_rom(rom.data(), rom.size());
+    for (const RegisteredModule& registered : modules) {
+        if (registered.module->rom_size == rom.size() && registered.module->rom_hash == hash) {
+            _module = registered.module;
+            _slots = registered.slots.get();
+            return;
+        }
+    }
+}
+
+uint32_t RecompiledCode::run(uint64_t until) {
+    CPU& cpu = gb.cpu();
+    if (!_slots || cpu._halted || cpu.halt_bug || cpu._ime_enable_next_cycle) {
+        return 0;
+    }
+    if (cpu._ime_flag && cpu._pending_interrupts) {
+        // Interrupt dispatch is left to the interpreter
+        return 0;
+    }
+
+    uint16_t address = cpu.registers.pc;
+    const uint8_t* code = gb.code_pointer(address);
+    const std::vector<uint8_t>& rom = gb.cartridge().rom();
+    if (!code || code < rom.data() || code >= rom.data() + _slots->size()) {
+        return 0;
+    }
+
+    // The translation assumed bank 0 runs from 0x0000 and every other bank from 0x4000,
+    // which an MBC1 in its alternate banking mode doesn't follow.
+    size_t offset = code - rom.data();
+    if ((offset < ROM_SIZE) != (address < ROM_SIZE)) {
+        return 0;
+    }
+
+    const Slot& slot = (*_slots)[offset];
+    if (!slot.function) {
+        return 0;
+    }
+
+    RecompiledContext context(gb, until);
+    cpu._block_exit_requested = 0;
+    uint32_t instructions = slot.function(context, slot.entry);
+    stats.block_runs++;
+    stats.instructions += instructions;
+    return instructions;
+}
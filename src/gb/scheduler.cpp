@@ -0,0 +1,41 @@
+#include "scheduler.h"
+
+Scheduler::Scheduler() {
+    clear();
+}
+
+void Scheduler::schedule(SchedulerEvent::SchedulerEvent event, uint64_t cycle) {
+    _deadlines[event] = cycle;
+    update_next_deadline();
+}
+
+void Scheduler::cancel(SchedulerEvent::SchedulerEvent event) {
+    schedule(event, NO_DEADLINE);
+}
+
+void Scheduler::clear() {
+    for (int i = 0; i < SchedulerEvent::Count; i++) {
+        _deadlines[i] = NO_DEADLINE;
+    }
+    _next_deadline = NO_DEADLINE;
+}
+
+void Scheduler::save_state(StateWriter& state) const {
+    state.write(_deadlines);
+}
+
+void Scheduler::load_state(StateReader& state) {
+    state.read(_deadlines);
+    update_next_deadline();
+}
+
+void Scheduler::update_next_deadline() {
+    // Only a handful of events, a linear scan beats maintaining a heap.
+    uint64_t next = NO_DEADLINE;
+    for (int i = 0; i < SchedulerEvent::Count; i++) {
+        if (_deadlines[i] < next) {
+            next = _deadlines[i];
+        }
+    }
+    _next_deadline = next;
+}
\ No newline at end of file
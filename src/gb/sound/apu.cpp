@@ -1,4 +1,5 @@
 #include "apu.h"
+#include <algorithm>
 #include "gbsystem.h"
 #include "utils.h"
 
@@ -10,21 +11,90 @@ APU::APU(GBSystem& gb) :
     gb.add_register_callbacks(this, {NR50, NR51, NR52}); // Global Registers
 }
 
-void APU::tick() {
-    if (!_enabled) {
+void APU::sync(uint64_t cycle) {
+    // Requires the timer to already be caught up to this cycle, for DIV.
+    uint16_t div_mask = gb.cgb_mode() ? 0x3FFF : 0x1FFF;
+
+    while (_sync_cycle <= cycle) {
+        // Split into segments at every DIV_APU update. The channels hand their output changes
+        // to the mixer themselves, timestamped, so output samples don't need to split them.
+        uint64_t segment_end = cycle + 1;
+
+        if (_enabled) {
+            uint16_t div = gb.timer().div_at(_sync_cycle);
+            if ((div & div_mask) == 0) {
+                div_tick();
+                if (_sample_interval > 0) {
+                    update_mixer(_sync_cycle);
+                }
+            }
+            segment_end = std::min(segment_end, _sync_cycle + (div_mask + 1) - (div & div_mask));
+        }
+
+        uint32_t elapsed = segment_end - _sync_cycle;
+        if (_enabled) {
+            pulse_channel_1.advance(_sync_cycle, elapsed);
+            pulse_channel_2.advance(_sync_cycle, elapsed);
+            wave_channel_3.advance(_sync_cycle, elapsed);
+            noise_channel_4.advance(_sync_cycle, elapsed);
+        }
+        _sync_cycle = segment_end;
+    }
+
+    if (_sample_interval > 0) {
+        _mixer.read_samples(_sync_cycle, sample_buffer);
+    }
+}
+
+void APU::reset_sync_cycle() {
+    GBComponent::reset_sync_cycle();
+    if (_sample_interval > 0) {
+        // The mixer's timeline starts over with the system's
+        _mixer.reset(_sample_interval, _sync_cycle);
+        update_mixer(_sync_cycle);
+    }
+}
+
+void APU::set_sample_interval(double cycles) {
+    if (cycles == _sample_interval) {
         return;
     }
 
-    // Check for DIV_APU updates
-    uint16_t div_mask = gb.cgb_mode() ? 0x3FFF : 0x1FFF;
-    if ((gb.timer().div_full() & div_mask) == 0) {
-        div_tick();
+    if (cycles <= 0) {
+        _sample_interval = 0;
+        pulse_channel_1.set_mixer(nullptr, 0);
+        pulse_channel_2.set_mixer(nullptr, 1);
+        wave_channel_3.set_mixer(nullptr, 2);
+        noise_channel_4.set_mixer(nullptr, 3);
+        return;
+    }
+
+    if (_sample_interval > 0) {
+        _mixer.set_rate(cycles, _sync_cycle);
+        _sample_interval = cycles;
+        return;
     }
 
-    pulse_channel_1.tick();
-    pulse_channel_2.tick();
-    wave_channel_3.tick();
-    noise_channel_4.tick();
+    _sample_interval = cycles;
+    _mixer.reset(cycles, _sync_cycle);
+    pulse_channel_1.set_mixer(&_mixer, 0);
+    pulse_channel_2.set_mixer(&_mixer, 1);
+    wave_channel_3.set_mixer(&_mixer, 2);
+    noise_channel_4.set_mixer(&_mixer, 3);
+    update_mixer(_sync_cycle);
+}
+
+void APU::update_mixer(uint64_t cycle) {
+    for (int side = 0; side < 2; side++) {
+        int32_t volume = _enabled ? (side ? _right_volume : _left_volume) + 1 : 0;
+        for (uint8_t channel = 0; channel < SOUND_CHANNELS; channel++) {
+            _mixer.set_gain(side, channel, cycle, _channel_panning[side][channel] ? volume : 0);
+        }
+    }
+    pulse_channel_1.update_output(cycle);
+    pulse_channel_2.update_output(cycle);
+    wave_channel_3.update_output(cycle);
+    noise_channel_4.update_output(cycle);
 }
 
 void APU::div_tick() {
@@ -35,23 +105,6 @@ void APU::div_tick() {
     noise_channel_4.div_tick(div_apu);
 }
 
-int16_t APU::current_sample(bool right_channel) {
-    if (!_enabled) {
-        return 0;
-    }
-
-    int16_t sum = 0;
-    sum += _channel_panning[right_channel][0] ? pulse_channel_1.current_sample() : 0;
-    sum += _channel_panning[right_channel][1] ? pulse_channel_2.current_sample() : 0;
-    sum += _channel_panning[right_channel][2] ? wave_channel_3.current_sample()  : 0;
-    sum += _channel_panning[right_channel][3] ? noise_channel_4.current_sample() : 0;
-
-    float volume = right_channel ? _right_volume : _left_volume;
-    sum = (int16_t) (sum * ((volume + 1) / 8));
-
-    return sum;
-}
-
 uint8_t APU::read_io_register(uint16_t address) {
 
     if (address >= SND_P1_ORIGIN && address < SND_P1_ORIGIN + 5) {
@@ -158,4 +211,47 @@ void APU::write_io_register(uint16_t address, uint8_t value) {
         break;
     }
     }
+
+    if (_sample_interval > 0) {
+        update_mixer(_sync_cycle);
+    }
+}
+
+// The sample interval and buffer belong to the frontend and aren't part of the state.
+void APU::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(_enabled);
+    state.write(_channel_panning);
+    state.write(_vin_left);
+    state.write(_left_volume);
+    state.write(_vin_right);
+    state.write(_right_volume);
+    state.write(div_apu);
+
+    pulse_channel_1.save_state(state);
+    pulse_channel_2.save_state(state);
+    wave_channel_3.save_state(state);
+    noise_channel_4.save_state(state);
+}
+
+void APU::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(_enabled);
+    state.read(_channel_panning);
+    state.read(_vin_left);
+    state.read(_left_volume);
+    state.read(_vin_right);
+    state.read(_right_volume);
+    state.read(div_apu);
+
+    pulse_channel_1.load_state(state);
+    pulse_channel_2.load_state(state);
+    wave_channel_3.load_state(state);
+    noise_channel_4.load_state(state);
+
+    if (_sample_interval > 0) {
+        // Whatever was still in the mixer belongs to the timeline that was left
+        _mixer.reset(_sample_interval, _sync_cycle);
+        update_mixer(_sync_cycle);
+    }
 }
\ No newline at end of file
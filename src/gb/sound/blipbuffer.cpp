@@ -0,0 +1,106 @@
+#include "blipbuffer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Kernel {
+    int32_t taps[BLIP_PHASES][BLIP_KERNEL_WIDTH];
+};
+
+// Blackman windowed sinc, cut off a little below the output's Nyquist frequency. Every
+// phase is rounded to integers that add up to exactly 1 << BLIP_KERNEL_BITS, so steps
+// come out at exactly the right height.
+Kernel make_kernel() {
+    constexpr double CUTOFF = 0.45; // Of the output sample rate
+    constexpr double HALF_WIDTH = BLIP_KERNEL_WIDTH / 2;
+    const double pi = std::acos(-1.0);
+
+    Kernel kernel;
+    for (int phase = 0; phase < BLIP_PHASES; phase++) {
+        double values[BLIP_KERNEL_WIDTH];
+        double sum = 0;
+        for (int tap = 0; tap < BLIP_KERNEL_WIDTH; tap++) {
+            double x = (tap + 1 - HALF_WIDTH) - ((double) phase / BLIP_PHASES);
+            double sinc = (x == 0) ? 1.0 : std::sin(2 * pi * CUTOFF * x) / (2 * pi * CUTOFF * x);
+            double window = 0.42 + 0.5 * std::cos(pi * x / HALF_WIDTH) + 0.08 * std::cos(2 * pi * x / HALF_WIDTH);
+            values[tap] = sinc * std::max(0.0, window);
+            sum += values[tap];
+        }
+
+        int32_t total = 0;
+        int largest = 0;
+        for (int tap = 0; tap < BLIP_KERNEL_WIDTH; tap++) {
+            kernel.taps[phase][tap] = (int32_t) std::lround(values[tap] / sum * (1 << BLIP_KERNEL_BITS));
+            total += kernel.taps[phase][tap];
+            if (kernel.taps[phase][tap] > kernel.taps[phase][largest]) {
+                largest = tap;
+            }
+        }
+        kernel.taps[phase][largest] += (1 << BLIP_KERNEL_BITS) - total;
+    }
+    return kernel;
+}
+
+const Kernel& kernel() {
+    static const Kernel kernel = make_kernel();
+    return kernel;
+}
+
+}
+
+void BlipBuffer::clear(double cycles_per_sample, uint64_t cycle) {
+    _deltas.clear();
+    _read_offset = 0;
+    _sums[0] = _sums[1] = 0;
+    _base_cycle = cycle;
+    _base_position = 0;
+    set_rate(cycles_per_sample, cycle);
+}
+
+void BlipBuffer::set_rate(double cycles_per_sample, uint64_t cycle) {
+    _base_position = position(cycle);
+    _base_cycle = cycle;
+    _samples_per_cycle = (uint64_t) std::llround(std::ldexp(1.0 / cycles_per_sample, BLIP_FRACTION_BITS));
+}
+
+void BlipBuffer::add_delta(uint64_t cycle, int64_t left, int64_t right) {
+    uint64_t sample_position = position(cycle);
+    size_t index = sample_position >> BLIP_FRACTION_BITS;
+    int phase = (sample_position >> (BLIP_FRACTION_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+
+    const int32_t* taps = kernel().taps[phase];
+    int64_t* deltas = reserve(index + BLIP_KERNEL_WIDTH) + (index * 2);
+    for (int tap = 0; tap < BLIP_KERNEL_WIDTH; tap++) {
+        deltas[tap * 2] += left * taps[tap];
+        deltas[tap * 2 + 1] += right * taps[tap];
+    }
+}
+
+void BlipBuffer::read_samples(uint64_t cycle, std::vector<int16_t>& out, int shift) {
+    uint64_t end_position = position(cycle);
+    size_t count = end_position >> BLIP_FRACTION_BITS;
+    if (count == 0) {
+        return;
+    }
+
+    const int64_t* deltas = reserve(count);
+    size_t start = out.size();
+    out.resize(start + (count * 2));
+    for (size_t i = 0; i < count * 2; i++) {
+        int64_t& sum = _sums[i % 2];
+        sum += deltas[i];
+        int64_t sample = sum >> (BLIP_KERNEL_BITS + shift);
+        out[start + i] = (int16_t) std::min<int64_t>(INT16_MAX, std::max<int64_t>(INT16_MIN, sample));
+    }
+    // Read samples are only erased from the front once in a while, moving what's left down
+    _read_offset += count;
+    if (_read_offset >= BLIP_COMPACT_SAMPLES) {
+        _deltas.erase(_deltas.begin(), _deltas.begin() + (_read_offset * 2));
+        _read_offset = 0;
+    }
+
+    // Rebase on the cycle that was read up to, to keep positions small
+    _base_cycle = cycle;
+    _base_position = end_position - ((uint64_t) count << BLIP_FRACTION_BITS);
+}
@@ -1,4 +1,5 @@
 #include "noisechannel.h"
+#include <algorithm>
 #include "utils.h"
 
 NoiseChannel::NoiseChannel(uint16_t base_address) :
@@ -7,22 +8,71 @@ NoiseChannel::NoiseChannel(uint16_t base_address) :
 
 }
 
-void NoiseChannel::tick() {
+void NoiseChannel::advance(uint64_t cycle, uint32_t cycles) {
     if (!_active || !_dac_enabled) {
         return;
     }
 
-    if (_timer-- == 0) {
-        bool inserted_value = !((_lsfr & 1) ^ ((_lsfr >> 1) & 1));
-        _lsfr = utils::set_bit_value(_lsfr, 15, inserted_value);
-        if (_7_bit_lsfr) {
-            _lsfr = utils::set_bit_value(_lsfr, 7, inserted_value);
+    // The LSFR has to be clocked one step at a time.
+    uint16_t reload = NOISE_TIMER_DIVISORS[_clock_divider] << _clock_shift;
+    if (_mixer) {
+        // Volume can't change in here, only which of the two levels is output
+        const int16_t levels[2] = {sample_for(false), sample_for(true)};
+        uint32_t period = reload + 1;
+        while (cycles > _timer) {
+            cycle += _timer + 1;
+            cycles -= _timer + 1;
+            _timer = reload;
+            step_lsfr();
+            _mixer->set_noise_level(cycle - 1, levels[_shifted_value]);
+
+            // The steps after that which stay within the same output sample each hold the
+            // level for a whole period, so the mixer only needs to know how many held which
+            uint64_t steps = std::min<uint64_t>(cycles, _mixer->noise_sample_end() - cycle) / period;
+            if (steps == 0) {
+                continue;
+            }
+            uint64_t high_steps = step_lsfr(steps);
+            int64_t held = ((int64_t) levels[0] * (int64_t) (steps - high_steps)) + ((int64_t) levels[1] * (int64_t) high_steps);
+            cycle += steps * period;
+            cycles -= steps * period;
+            _mixer->hold_noise_level(cycle - 1, held * period, levels[_shifted_value]);
         }
-        _lsfr >>= 1;
-        _shifted_value = _lsfr & 1;
+        _timer -= cycles;
+        return;
+    }
+
+    while (cycles > _timer) {
+        cycles -= _timer + 1;
+        step_lsfr();
+        _timer = reload;
+    }
+    _timer -= cycles;
+}
 
-        _timer = NOISE_TIMER_DIVISORS[_clock_divider] << _clock_shift;
+void NoiseChannel::step_lsfr() {
+    bool inserted_value = !((_lsfr & 1) ^ ((_lsfr >> 1) & 1));
+    _lsfr = utils::set_bit_value(_lsfr, 15, inserted_value);
+    if (_7_bit_lsfr) {
+        _lsfr = utils::set_bit_value(_lsfr, 7, inserted_value);
     }
+    _lsfr >>= 1;
+    _shifted_value = _lsfr & 1;
+}
+
+uint64_t NoiseChannel::step_lsfr(uint64_t steps) {
+    // Same as above, without going through the members every step
+    uint16_t lsfr = _lsfr;
+    uint16_t inserted_bits = _7_bit_lsfr ? 0x8080 : 0x8000;
+    uint64_t high_steps = 0;
+    for (uint64_t i = 0; i < steps; i++) {
+        high_steps += lsfr & 1;
+        uint16_t inserted_value = ~(lsfr ^ (lsfr >> 1)) & 1;
+        lsfr = ((lsfr & ~inserted_bits) | (inserted_value ? inserted_bits : 0)) >> 1;
+    }
+    _lsfr = lsfr;
+    _shifted_value = lsfr & 1;
+    return high_steps;
 }
 
 void NoiseChannel::trigger() {
@@ -38,8 +88,11 @@ int16_t NoiseChannel::current_sample() {
     if (!_active || !_dac_enabled) {
         return 0;
     }
+    return sample_for(_shifted_value);
+}
 
-    float sample = !_shifted_value;
+int16_t NoiseChannel::sample_for(bool shifted_value) const {
+    float sample = !shifted_value;
     sample -= 0.5f;
     sample *= (_volume / 15.0f);
 
@@ -130,4 +183,22 @@ void NoiseChannel::clear_registers() {
     _length_enable = false;
 
     _active = false;
+}
+
+void NoiseChannel::save_state(StateWriter& state) const {
+    SoundChannel::save_state(state);
+    state.write(_lsfr);
+    state.write(_shifted_value);
+    state.write(_7_bit_lsfr);
+    state.write(_clock_divider);
+    state.write(_clock_shift);
+}
+
+void NoiseChannel::load_state(StateReader& state) {
+    SoundChannel::load_state(state);
+    state.read(_lsfr);
+    state.read(_shifted_value);
+    state.read(_7_bit_lsfr);
+    state.read(_clock_divider);
+    state.read(_clock_shift);
 }
\ No newline at end of file
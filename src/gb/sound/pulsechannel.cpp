@@ -8,19 +8,44 @@ PulseChannel::PulseChannel(uint16_t base_address, bool has_frequency_sweep) :
 
 }
 
-void PulseChannel::tick() {
+void PulseChannel::advance(uint64_t cycle, uint32_t cycles) {
     if (!_active || !_dac_enabled) {
         return;
     }
 
-    if (_timer-- == 0) {
-        _duty_cycle_index <<= 1;
-        if (_duty_cycle_index == 0) {
-            _duty_cycle_index = 1;
+    if (cycles <= _timer) {
+        _timer -= cycles;
+        return;
+    }
+
+    // Timer runs out once, then reloads every (period + 1) cycles.
+    uint32_t reload = (2048 - _period) * 4;
+    if (_mixer) {
+        // Every step has to reach the mixer at the cycle it happens on
+        uint64_t end_cycle = cycle + cycles;
+        uint64_t step_cycle = cycle + _timer;
+        for (; step_cycle < end_cycle; step_cycle += reload + 1) {
+            step_duty_cycle(1);
+            update_output(step_cycle);
         }
+        _timer = step_cycle - end_cycle;
+        return;
+    }
+
+    cycles -= _timer + 1;
+    step_duty_cycle(1 + (cycles / (reload + 1)));
+    _timer = reload - (cycles % (reload + 1));
+}
 
-        _timer = (2048 - _period) * 4;
+void PulseChannel::step_duty_cycle(uint32_t steps) {
+    if (_duty_cycle_index == 0) {
+        _duty_cycle_index = 1;
+        steps--;
     }
+
+    // Rotate left through the 8 duty positions
+    steps %= 8;
+    _duty_cycle_index = (_duty_cycle_index << steps) | (_duty_cycle_index >> (8 - steps));
 }
 
 uint16_t PulseChannel::calculate_sweep_period() {
@@ -187,4 +212,26 @@ void PulseChannel::clear_registers() {
     _length_enable = false;
 
     _active = false;
+}
+
+void PulseChannel::save_state(StateWriter& state) const {
+    SoundChannel::save_state(state);
+    state.write(_frequency_sweep_enabled);
+    state.write(_frequency_sweep_pace);
+    state.write(_frequency_sweep_downwards);
+    state.write(_frequency_sweep_step);
+    state.write(_duty_cycle);
+    state.write(_duty_cycle_index);
+    state.write(_frequency_sweep_timer);
+}
+
+void PulseChannel::load_state(StateReader& state) {
+    SoundChannel::load_state(state);
+    state.read(_frequency_sweep_enabled);
+    state.read(_frequency_sweep_pace);
+    state.read(_frequency_sweep_downwards);
+    state.read(_frequency_sweep_step);
+    state.read(_duty_cycle);
+    state.read(_duty_cycle_index);
+    state.read(_frequency_sweep_timer);
 }
\ No newline at end of file
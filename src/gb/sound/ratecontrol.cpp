@@ -0,0 +1,38 @@
+#include "ratecontrol.h"
+#include <algorithm>
+
+namespace {
+
+constexpr double FILL_SMOOTHING = 0.1;   // Share of each new fill reading in the average
+constexpr double DRIFT_UPDATES = 600.0;  // Updates for a full error to learn the full adjustment
+
+}
+
+RateControl::RateControl(double max_adjustment)
+    : _max_adjustment(max_adjustment)
+{
+
+}
+
+void RateControl::reset() {
+    _average_fill = -1;
+    _drift = 0;
+}
+
+double RateControl::update(double fill, double target) {
+    if (target <= 0) {
+        return 1;
+    }
+
+    // Reads take the device's chunks all at once, so the fill is a sawtooth to begin with
+    if (_average_fill < 0) {
+        _average_fill = fill;
+    } else {
+        _average_fill += (fill - _average_fill) * FILL_SMOOTHING;
+    }
+
+    // Positive when running low, so more samples get made
+    double error = std::clamp((target - _average_fill) / target, -1.0, 1.0);
+    _drift = std::clamp(_drift + (error * _max_adjustment / DRIFT_UPDATES), -_max_adjustment, _max_adjustment);
+    return 1 + std::clamp((error * _max_adjustment) + _drift, -_max_adjustment, _max_adjustment);
+}
@@ -0,0 +1,69 @@
+#include "samplering.h"
+#include <algorithm>
+#include <cstring>
+
+SampleRing::SampleRing(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    _mask = rounded - 1;
+    _samples.assign(rounded * 2, 0);
+}
+
+size_t SampleRing::write(const int16_t* samples, size_t count) {
+    uint64_t write_position = _write_position.load(std::memory_order_relaxed);
+    // Acquire: the consumer is done with everything up to its position
+    uint64_t read_position = _read_position.load(std::memory_order_acquire);
+    size_t space = capacity() - (size_t) (write_position - read_position);
+    if (count > space) {
+        _overruns.fetch_add(1, std::memory_order_relaxed);
+        _dropped.fetch_add(count - space, std::memory_order_relaxed);
+        count = space;
+    }
+
+    // At most two copies, around the end of the ring
+    size_t start = write_position & _mask;
+    size_t first = std::min(count, capacity() - start);
+    std::memcpy(&_samples[start * 2], samples, first * 2 * sizeof(int16_t));
+    std::memcpy(&_samples[0], samples + (first * 2), (count - first) * 2 * sizeof(int16_t));
+
+    // Release: the samples are in before the consumer can see them
+    _write_position.store(write_position + count, std::memory_order_release);
+    return count;
+}
+
+size_t SampleRing::read(int16_t* samples, size_t count) {
+    uint64_t read_position = _read_position.load(std::memory_order_relaxed);
+    uint64_t write_position = _write_position.load(std::memory_order_acquire);
+    size_t available = (size_t) (write_position - read_position);
+    if (count > available) {
+        _underruns.fetch_add(1, std::memory_order_relaxed);
+        _missing.fetch_add(count - available, std::memory_order_relaxed);
+        count = available;
+    }
+
+    size_t start = read_position & _mask;
+    size_t first = std::min(count, capacity() - start);
+    std::memcpy(samples, &_samples[start * 2], first * 2 * sizeof(int16_t));
+    std::memcpy(samples + (first * 2), &_samples[0], (count - first) * 2 * sizeof(int16_t));
+
+    // Release: done reading them before the producer can overwrite them
+    _read_position.store(read_position + count, std::memory_order_release);
+    return count;
+}
+
+void SampleRing::discard() {
+    _read_position.store(_write_position.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+SampleRingStats SampleRing::stats() const {
+    SampleRingStats stats;
+    stats.written = _write_position.load(std::memory_order_relaxed);
+    stats.read = _read_position.load(std::memory_order_relaxed);
+    stats.overruns = _overruns.load(std::memory_order_relaxed);
+    stats.underruns = _underruns.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.missing = _missing.load(std::memory_order_relaxed);
+    return stats;
+}
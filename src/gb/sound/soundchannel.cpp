@@ -44,4 +44,34 @@ void SoundChannel::trigger() {
 
     _volume = _initial_volume;
     _volume_sweep_timer = _volume_sweep_pace;
+}
+
+void SoundChannel::save_state(StateWriter& state) const {
+    state.write(_initial_length_timer);
+    state.write(_initial_volume);
+    state.write(_volume_sweep_increments);
+    state.write(_volume_sweep_pace);
+    state.write(_length_enable);
+    state.write(_period);
+    state.write(_dac_enabled);
+    state.write(_active);
+    state.write(_volume);
+    state.write(_timer);
+    state.write(_volume_sweep_timer);
+    state.write(_length_timer);
+}
+
+void SoundChannel::load_state(StateReader& state) {
+    state.read(_initial_length_timer);
+    state.read(_initial_volume);
+    state.read(_volume_sweep_increments);
+    state.read(_volume_sweep_pace);
+    state.read(_length_enable);
+    state.read(_period);
+    state.read(_dac_enabled);
+    state.read(_active);
+    state.read(_volume);
+    state.read(_timer);
+    state.read(_volume_sweep_timer);
+    state.read(_length_timer);
 }
\ No newline at end of file
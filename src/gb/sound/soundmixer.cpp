@@ -0,0 +1,63 @@
+#include "soundmixer.h"
+#include <algorithm>
+#include <iterator>
+
+void SoundMixer::reset(double cycles_per_sample, uint64_t cycle) {
+    _output.clear(cycles_per_sample, cycle);
+    std::fill(std::begin(_levels), std::end(_levels), 0);
+    _noise_level = 0;
+    _noise_area = 0;
+    _noise_cycle = cycle;
+    _noise_sample_start = cycle;
+    _noise_sample_end = _output.next_sample_cycle(cycle);
+}
+
+void SoundMixer::set_rate(double cycles_per_sample, uint64_t cycle) {
+    set_noise_level(cycle, _noise_level);
+    _output.set_rate(cycles_per_sample, cycle);
+    // The sample in progress keeps its start, and ends where the new rate puts it
+    _noise_sample_end = _output.next_sample_cycle(cycle);
+}
+
+void SoundMixer::set_gain(uint8_t side, uint8_t channel, uint64_t cycle, int32_t gain) {
+    int32_t change = gain - _gains[side][channel];
+    if (change == 0) {
+        return;
+    }
+    _gains[side][channel] = gain;
+    if (_levels[channel]) {
+        int64_t delta = (int64_t) change * _levels[channel];
+        _output.add_delta(cycle, side ? 0 : delta, side ? delta : 0);
+    }
+}
+
+void SoundMixer::finish_noise_samples(uint64_t cycle) {
+    _noise_area += (int64_t) _noise_level * (int64_t) (_noise_sample_end - _noise_cycle);
+    set_noise_output(_noise_sample_start, (int16_t) (_noise_area / (int64_t) (_noise_sample_end - _noise_sample_start)));
+    _noise_area = 0;
+    _noise_cycle = _noise_sample_start = _noise_sample_end;
+    _noise_sample_end = _output.next_sample_cycle(_noise_cycle);
+
+    if (cycle >= _noise_sample_end) {
+        // Whole samples from there up to this cycle all just hold the level
+        set_noise_output(_noise_cycle, _noise_level);
+        _noise_cycle = _noise_sample_start = _output.sample_start_cycle(cycle);
+        _noise_sample_end = _output.next_sample_cycle(cycle);
+    }
+}
+
+void SoundMixer::set_noise_output(uint64_t cycle, int16_t level) {
+    int32_t change = level - _levels[SOUND_NOISE_CHANNEL];
+    _levels[SOUND_NOISE_CHANNEL] = level;
+    if (change) {
+        _output.add_sample_delta(cycle, (int64_t) change * _gains[0][SOUND_NOISE_CHANNEL],
+            (int64_t) change * _gains[1][SOUND_NOISE_CHANNEL]);
+    }
+}
+
+void SoundMixer::read_samples(uint64_t cycle, std::vector<int16_t>& samples) {
+    // Anything the noise channel held since its last step has to be in before it's read
+    set_noise_level(cycle, _noise_level);
+    // A gain of 8 is full master volume
+    _output.read_samples(cycle, samples, 3);
+}
@@ -11,19 +11,42 @@ WaveChannel::WaveChannel(uint16_t base_address) :
     }
 }
 
-void WaveChannel::tick() {
-    if (!_active || !_dac_enabled) {
+void WaveChannel::advance(uint64_t cycle, uint32_t cycles) {
+    if (!_active || !_dac_enabled || cycles == 0) {
+        return;
+    }
+
+    if (cycles <= _timer) {
+        _timer -= cycles;
+        _wave_sample_read = false;
         return;
     }
 
-    _wave_sample_read = false;
-    if (_timer-- == 0) {
-        _wave_index++;
-        _wave_index %= 32;
-        _current_wave_sample = _wave_samples[_wave_index];
-        _wave_sample_read = true;
-        _timer = (2048 - _period) * 2;
+    // Timer runs out once, then reloads every (period + 1) cycles.
+    uint32_t reload = (2048 - _period) * 2;
+    if (_mixer) {
+        // Every sample has to reach the mixer at the cycle it's fetched on
+        uint64_t end_cycle = cycle + cycles;
+        uint64_t step_cycle = cycle + _timer;
+        for (; step_cycle < end_cycle; step_cycle += reload + 1) {
+            _wave_index = (_wave_index + 1) % 32;
+            _current_wave_sample = _wave_samples[_wave_index];
+            update_output(step_cycle);
+        }
+        _wave_sample_read = step_cycle - (reload + 1) == end_cycle - 1;
+        _timer = step_cycle - end_cycle;
+        return;
     }
+
+    cycles -= _timer + 1;
+    uint32_t steps = 1 + (cycles / (reload + 1));
+    uint32_t since_last_step = cycles % (reload + 1);
+
+    _wave_index = (_wave_index + steps) % 32;
+    _current_wave_sample = _wave_samples[_wave_index];
+    // Only readable on the exact cycle the sample was fetched.
+    _wave_sample_read = since_last_step == 0;
+    _timer = reload - since_last_step;
 }
 
 void WaveChannel::div_tick(uint8_t div_apu) {
@@ -163,4 +186,20 @@ void WaveChannel::clear_registers() {
     _length_enable = false;
 
     _active = false;
+}
+
+void WaveChannel::save_state(StateWriter& state) const {
+    SoundChannel::save_state(state);
+    state.write(_wave_samples);
+    state.write(_wave_index);
+    state.write(_current_wave_sample);
+    state.write(_wave_sample_read);
+}
+
+void WaveChannel::load_state(StateReader& state) {
+    SoundChannel::load_state(state);
+    state.read(_wave_samples);
+    state.read(_wave_index);
+    state.read(_current_wave_sample);
+    state.read(_wave_sample_read);
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include "tilecache.h"
+#include <algorithm>
+#include <iterator>
+
+TileCache::TileCache(const uint8_t* vram) :
+    _vram(vram)
+{}
+
+void TileCache::clear() {
+    std::fill(std::begin(_valid), std::end(_valid), false);
+}
+
+void TileCache::decode(uint16_t tile) {
+    const uint8_t* data = _vram + (tile * 16);
+    for (int row = 0; row < 8; row++) {
+        uint8_t* pixels = _pixels[tile][0] + (row * 8);
+        _kernels->decode_row(data[row * 2], data[row * 2 + 1], pixels);
+        std::reverse_copy(pixels, pixels + 8, _pixels[tile][1] + (row * 8));
+    }
+    _valid[tile] = true;
+}
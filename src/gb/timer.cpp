@@ -10,16 +10,47 @@ Timer::Timer(GBSystem& gb_param)
     gb.add_register_callbacks(this, {DIV, TIMA, TMA, TAC});
 }
 
-void Timer::tick() {
-    // No need to check every 256 cycles,
-    // This is a 16 bit value and the upper 8 bits are the true DIV.
-    _div++;
-
-    uint16_t mask = TIMA_MASKS[_clock_select];
-    if ((_div & mask) == 0) {
-        // Increment TIMA
-        tick_tima();
+void Timer::sync(uint64_t cycle) {
+    if (cycle < _sync_cycle) {
+        return;
+    }
+
+    // No need to step every cycle,
+    // DIV is a 16 bit counter and the upper 8 bits are the true DIV.
+    // TIMA increments every time the masked bits of DIV wrap around to 0.
+    uint64_t elapsed = cycle + 1 - _sync_cycle;
+    uint32_t period = TIMA_MASKS[_clock_select] + 1;
+    uint64_t increments = ((_div + elapsed) / period) - (_div / period);
+
+    _div += elapsed;
+    _sync_cycle = cycle + 1;
+
+    if (enabled() && increments > 0) {
+        if (_tima + increments > 0xFF) {
+            // Overflowed, request a timer interrupt.
+            gb.request_interrupt(Interrupts::Timer);
+        }
+        _tima += increments;
+    }
+
+    schedule_overflow();
+}
+
+void Timer::reset_sync_cycle() {
+    GBComponent::reset_sync_cycle();
+    schedule_overflow();
+}
+
+void Timer::schedule_overflow() {
+    if (!enabled()) {
+        gb.scheduler().cancel(SchedulerEvent::Timer);
+        return;
     }
+
+    uint32_t period = TIMA_MASKS[_clock_select] + 1;
+    uint64_t cycles_until_increment = period - (_div & TIMA_MASKS[_clock_select]);
+    uint64_t cycles_until_overflow = cycles_until_increment + ((0xFF - _tima) * period);
+    gb.scheduler().schedule(SchedulerEvent::Timer, _sync_cycle - 1 + cycles_until_overflow);
 }
 
 void Timer::tick_tima() {
@@ -84,4 +115,24 @@ void Timer::write_io_register(uint16_t address, uint8_t value) {
         break;
     }
     }
+
+    schedule_overflow();
+}
+
+void Timer::save_state(StateWriter& state) const {
+    GBComponent::save_state(state);
+    state.write(_div);
+    state.write(_tima);
+    state.write(_tma);
+    state.write(_enabled);
+    state.write(_clock_select);
+}
+
+void Timer::load_state(StateReader& state) {
+    GBComponent::load_state(state);
+    state.read(_div);
+    state.read(_tima);
+    state.read(_tma);
+    state.read(_enabled);
+    state.read(_clock_select);
 }
\ No newline at end of file
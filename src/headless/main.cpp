@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "batchrunner.h"
+#include "scgbe.h"
+
+// Input script: one "<frame> [buttons...]" entry per line, '#' starts a comment.
+// The listed buttons are held from that frame until the next entry.
+// e.g. "120 start", "180 a right", "200" (release everything)
+
+static int button_bit(const std::string& name) {
+    if (name == "right") return 0;
+    if (name == "left") return 1;
+    if (name == "up") return 2;
+    if (name == "down") return 3;
+    if (name == "a") return 4;
+    if (name == "b") return 5;
+    if (name == "select") return 6;
+    if (name == "start") return 7;
+    return -1;
+}
+
+static bool load_input_script(const std::string& filename, InputScript& script) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream tokens(line);
+        uint64_t frame;
+        if (!(tokens >> frame)) {
+            continue;
+        }
+
+        uint8_t state = 0xFF; // Active low, same as the joypad register
+        std::string button;
+        while (tokens >> button) {
+            for (char& c : button) {
+                c = std::tolower(c);
+            }
+            int bit = button_bit(button);
+            if (bit == -1) {
+                std::cerr << filename << ":" << line_number << ": unknown button '" << button << "'" << std::endl;
+                return false;
+            }
+            state = utils::set_bit_value(state, bit, 0);
+        }
+        script[frame] = state;
+    }
+    return true;
+}
+
+static uint64_t hash_bytes(const void* data, size_t length, uint64_t hash = 0xCBF29CE484222325) {
+    // FNV-1a, pass the previous hash to continue it
+    const uint8_t* bytes = (const uint8_t*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+    return hash;
+}
+
+// Folds the samples the APU made since the last call into the running hash, and empties its buffer.
+static void drain_samples(APU& apu, uint64_t& hash, uint64_t& count) {
+    std::vector<int16_t>& samples = apu.sample_buffer;
+    hash = hash_bytes(samples.data(), samples.size() * sizeof(int16_t), hash);
+    count += samples.size() / 2;
+    samples.clear();
+}
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <rom> [options]" << std::endl
+              << "  --frames N    Run for N frames (default 600)" << std::endl
+              << "  --cycles N    Run for N T-cycles instead of a number of frames" << std::endl
+              << "  --input FILE  Replay an input script" << std::endl
+              << "  --instances N Run N copies of the ROM in parallel (default 1)" << std::endl
+              << "  --threads N   Worker threads for --instances (default: all cores)" << std::endl
+              << "  --no-block-cache  Fetch and decode every instruction from memory" << std::endl
+              << "  --skip-idle-loops Fast-forward loops polling memory that can't change yet" << std::endl
+              << "  --dot-renderer    Draw every scanline dot by dot" << std::endl
+              << "  --frame-skip N    Only draw one frame out of every N + 1" << std::endl
+              << "  --no-render       Never draw to the framebuffer, for runs that only need RAM" << std::endl
+              << "  --audio-rate HZ   Synthesize stereo audio at HZ, and report the sample count and a hash" << std::endl
+              << "  --jit         Run hot code as native x86-64" << std::endl
+              << "  --jit-lockstep    Like --jit, checking every block against the interpreter" << std::endl
+              << "  --recompiled  Run the ROM's linked in scgbe-recompile module" << std::endl
+              << "  --recompiled-lockstep  Like --recompiled, checking every block against the interpreter" << std::endl;
+}
+
+static int run_batch(const std::vector<uint8_t>& rom, const InputScript& script, uint64_t frames, uint32_t instances, unsigned threads,
+                     CPUBackend::CPUBackend backend, bool block_cache, bool skip_idle_loops, bool scanline_rendering,
+                     uint32_t frame_skip, bool rendering) {
+    BatchRunner runner(threads);
+    try {
+        for (uint32_t i = 0; i < instances; i++) {
+            BatchSession& session = runner.session(runner.add_session(rom, frames));
+            session.input_script = script;
+            session.gb().cpu().block_cache().set_enabled(block_cache);
+            session.gb().set_cpu_backend(backend);
+            session.gb().set_idle_loop_skipping(skip_idle_loops);
+            session.gb().ppu().set_scanline_rendering(scanline_rendering);
+            session.gb().ppu().set_frame_skip(frame_skip);
+            session.gb().ppu().set_rendering(rendering);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    runner.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    // Every instance runs the same ROM and inputs, so they should all end up identical
+    uint64_t total_frames = 0;
+    uint64_t total_cycles = 0;
+    uint64_t hash = 0;
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < runner.session_count(); i++) {
+        BatchSession& session = runner.session(i);
+        if (!session.error.empty()) {
+            std::cerr << "Instance " << i << ": " << session.error << std::endl;
+        }
+
+        GBSystem& gb = session.gb();
+        total_frames += gb.frame_number;
+        total_cycles += gb.cycles;
+
+        uint64_t instance_hash = hash_bytes(gb.ppu().framebuffer, sizeof(gb.ppu().framebuffer));
+        if (i == 0) {
+            hash = instance_hash;
+        } else if (instance_hash != hash) {
+            mismatches++;
+        }
+    }
+
+    double seconds = elapsed.count();
+    std::cout << "instances:   " << instances << " on " << runner.thread_count() << " threads ("
+                                 << runner.steals() << " steals)" << std::endl
+              << "frames:      " << total_frames << std::endl
+              << "cycles:      " << total_cycles << std::endl
+              << "time:        " << std::fixed << std::setprecision(3) << seconds << " s" << std::endl
+              << "fps:         " << std::setprecision(1) << (total_frames / seconds) << std::endl
+              << "speed:       " << std::setprecision(2) << (total_cycles / seconds / 1e6) << " MHz" << std::endl
+              << "framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+    if (mismatches) {
+        std::cerr << std::dec << mismatches << " instances ended with a different framebuffer" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::string rom_filename;
+    std::string input_filename;
+    uint64_t frames = 600;
+    uint64_t cycles = 0;
+    uint32_t instances = 1;
+    unsigned threads = 0;
+    bool block_cache = true;
+    bool skip_idle_loops = false;
+    bool scanline_rendering = true;
+    uint32_t frame_skip = 0;
+    bool rendering = true;
+    uint32_t audio_rate = 0;
+    CPUBackend::CPUBackend backend = CPUBackend::Interpreter;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value) {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--cycles" && has_value) {
+            cycles = std::stoull(argv[++i]);
+        } else if (arg == "--input" && has_value) {
+            input_filename = argv[++i];
+        } else if (arg == "--instances" && has_value) {
+            instances = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--no-block-cache") {
+            block_cache = false;
+        } else if (arg == "--skip-idle-loops") {
+            skip_idle_loops = true;
+        } else if (arg == "--dot-renderer") {
+            scanline_rendering = false;
+        } else if (arg == "--frame-skip" && has_value) {
+            frame_skip = std::stoul(argv[++i]);
+        } else if (arg == "--no-render") {
+            rendering = false;
+        } else if (arg == "--audio-rate" && has_value) {
+            audio_rate = std::stoul(argv[++i]);
+        } else if (arg == "--jit") {
+            backend = CPUBackend::JIT;
+        } else if (arg == "--jit-lockstep") {
+            backend = CPUBackend::JITLockstep;
+        } else if (arg == "--recompiled") {
+            backend = CPUBackend::Recompiled;
+        } else if (arg == "--recompiled-lockstep") {
+            backend = CPUBackend::RecompiledLockstep;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (rom_filename.empty() && arg[0] != '-') {
+            rom_filename = arg;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rom_filename.empty() || instances == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (instances > 1 && cycles) {
+        std::cerr << "--cycles cannot be combined with --instances" << std::endl;
+        return 1;
+    }
+    if (instances > 1 && audio_rate) {
+        std::cerr << "--audio-rate cannot be combined with --instances" << std::endl;
+        return 1;
+    }
+
+    InputScript script;
+    if (!input_filename.empty() && !load_input_script(input_filename, script)) {
+        return 1;
+    }
+
+    std::ifstream rom_file(rom_filename, std::ios::in | std::ios::binary);
+    if (!rom_file.is_open()) {
+        std::cerr << "Failed to open " << rom_filename << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(rom_file)), std::istreambuf_iterator<char>());
+    rom_file.close();
+
+    if (instances > 1) {
+        return run_batch(rom, script, frames, instances, threads, backend, block_cache, skip_idle_loops, scanline_rendering, frame_skip, rendering);
+    }
+
+    std::unique_ptr<GBSystem> gb(new GBSystem(false));
+    gb->reset();
+    gb->cpu().block_cache().set_enabled(block_cache);
+    gb->ppu().set_scanline_rendering(scanline_rendering);
+    gb->ppu().set_frame_skip(frame_skip);
+    gb->ppu().set_rendering(rendering);
+    Cartridge& cartridge = gb->cartridge();
+    cartridge.load_rom(rom);
+    if (cartridge.header().calculate_header_checksum() != cartridge.header().header_checksum) {
+        std::cerr << "Invalid ROM header checksum" << std::endl;
+        return 1;
+    }
+
+    // Run as fast as possible
+    uint64_t audio_hash = hash_bytes(nullptr, 0);
+    uint64_t audio_samples = 0;
+    if (audio_rate) {
+        gb->apu().set_sample_interval((double) gb->clock_speed / audio_rate);
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    try {
+        gb->set_cpu_backend(backend);
+        gb->set_idle_loop_skipping(skip_idle_loops);
+        while (cycles ? gb->cycles < cycles : gb->frame_number < frames) {
+            auto input = script.find(gb->frame_number);
+            if (input != script.end()) {
+                gb->joypad().set_inputs(input->second);
+            }
+
+            if (cycles && cycles - gb->cycles < gb->cycles_per_frame()) {
+                // Partial frame at the end of a cycle limited run
+                gb->run_until(cycles);
+                gb->sync_to(cycles - 1);
+                drain_samples(gb->apu(), audio_hash, audio_samples);
+                break;
+            }
+            gb->run_frame();
+            drain_samples(gb->apu(), audio_hash, audio_samples);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Frame " << gb->frame_number << ": " << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    double seconds = elapsed.count();
+    uint64_t hash = hash_bytes(gb->ppu().framebuffer, sizeof(gb->ppu().framebuffer));
+    std::cout << "frames:      " << gb->frame_number << std::endl
+              << "cycles:      " << gb->cycles << std::endl
+              << "time:        " << std::fixed << std::setprecision(3) << seconds << " s" << std::endl
+              << "fps:         " << std::setprecision(1) << (gb->frame_number / seconds) << std::endl
+              << "speed:       " << std::setprecision(2) << (gb->cycles / seconds / 1e6) << " MHz ("
+                                 << (gb->cycles / seconds / gb->clock_speed) << "x)" << std::endl
+              << "framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+
+    const BlockCacheStats& block_stats = gb->cpu().block_cache().stats;
+    std::cout << "block cache: " << std::dec << std::setfill(' ') << std::setprecision(1) << (block_stats.hit_rate() * 100) << "% hits, "
+                                 << block_stats.blocks_built << " blocks built, "
+                                 << block_stats.invalidations << " invalidated" << std::endl;
+    std::cout << "halt skip:   " << (100.0 * gb->skip_stats.halt_cycles / std::max<uint64_t>(1, gb->cycles)) << "% of cycles, "
+                                 << (100.0 * gb->skip_stats.last_frame_halt_cycles / gb->cycles_per_frame()) << "% in the last frame" << std::endl;
+    const PPUStats& ppu_stats = gb->ppu().stats;
+    std::cout << "scanlines:   " << (100.0 * ppu_stats.fast_lines / std::max<uint64_t>(1, ppu_stats.fast_lines + ppu_stats.slow_lines))
+                                 << "% drawn in one go, " << ppu_stats.slow_lines << " dot by dot" << std::endl;
+    if (audio_rate) {
+        std::cout << "audio:       " << audio_samples << " samples at " << audio_rate << " Hz, hash "
+                                     << std::hex << std::setw(16) << std::setfill('0') << audio_hash
+                                     << std::dec << std::setfill(' ') << std::endl;
+    }
+    if (frame_skip || !rendering) {
+        std::cout << "rendering:   " << ppu_stats.rendered_frames << " frames drawn, " << ppu_stats.skipped_frames << " skipped" << std::endl;
+    }
+    if (skip_idle_loops) {
+        std::cout << "idle skip:   " << (100.0 * gb->skip_stats.idle_loop_cycles / std::max<uint64_t>(1, gb->cycles)) << "% of cycles, "
+                                     << (100.0 * gb->skip_stats.last_frame_idle_loop_cycles / gb->cycles_per_frame()) << "% in the last frame" << std::endl;
+    }
+    if (backend == CPUBackend::JIT || backend == CPUBackend::JITLockstep) {
+        const JitStats& jit_stats = gb->cpu().jit().stats;
+        std::cout << "jit:         " << (100.0 * jit_stats.instructions / std::max<uint64_t>(1, block_stats.hits + block_stats.misses + jit_stats.instructions))
+                                     << "% of instructions native, " << jit_stats.blocks_compiled << " blocks compiled, "
+                                     << jit_stats.flushes << " flushes" << std::endl;
+    }
+    if (backend == CPUBackend::Recompiled || backend == CPUBackend::RecompiledLockstep) {
+        const RecompiledStats& recompiled_stats = gb->cpu().recompiled().stats;
+        std::cout << "recompiled:  " << (100.0 * recompiled_stats.instructions / std::max<uint64_t>(1, block_stats.hits + block_stats.misses + recompiled_stats.instructions))
+                                     << "% of instructions translated, " << recompiled_stats.block_runs << " block runs" << std::endl;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "displaypanel.h"
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <string>
 #include <wx/dcbuffer.h>
 #include <wx/rawbmp.h>
@@ -8,20 +10,21 @@
 #include <iostream>
 
 extern EmulatorThread* emulator_thread;
-extern uint8_t inputs;
 extern bool open_emulator(std::string filename);
 
-constexpr uint8_t SCREEN_RGB_COLORS[4][3] = {
-    0x62, 0x68, 0x0D, // #62680D
-    0x48, 0x61, 0x35, // #486135
-    0x2E, 0x47, 0x3B, // #2E473B
-    0x21, 0x34, 0x2E, // #21342E
-};
-
 DisplayPanel* display_panel_instance = nullptr;
+static uint8_t inputs = 0xFF;
+static std::atomic<bool> refresh_pending {false};
 
+// Called on the emulator thread, the repaint itself has to happen on the UI thread. Frames
+// finished while one is already queued are picked up by that repaint.
 void on_frame_complete() {
-    display_panel_instance->Refresh();
+    if (!refresh_pending.exchange(true)) {
+        display_panel_instance->CallAfter([] {
+            refresh_pending = false;
+            display_panel_instance->Refresh();
+        });
+    }
 }
 
 DisplayPanel::DisplayPanel(wxFrame* parent)
@@ -38,22 +41,28 @@ bool DisplayPanel::OnDropFiles(wxCoord x, wxCoord y, const wxArrayString& files)
 
 void DisplayPanel::render(wxDC& draw_context) {
     if (emulator_thread) {
-        painting_mutex.Lock();
         wxAlphaPixelData bmdata(*image);
         wxAlphaPixelData::Iterator dst(bmdata);
 
+        // The latest frame the PPU finished. The emulator thread never writes to it.
+        const uint8_t* pixel = emulator_thread->frames().acquire();
+        size_t row_bytes = image->GetWidth() * 4;
         for (int y = 0; y < image->GetHeight(); y++) {
             dst.MoveTo(bmdata, 0, y);
+            if (FRAME_NATIVE_LAYOUT) {
+                std::memcpy(&dst.Data(), pixel, row_bytes);
+                pixel += row_bytes;
+                continue;
+            }
             for (int x = 0; x < image->GetWidth(); x++) {
-                uint8_t value = emulator_thread->gb().ppu().framebuffer[x + y * 160];
-                dst.Red() = SCREEN_RGB_COLORS[value][0];
-                dst.Green() = SCREEN_RGB_COLORS[value][1];
-                dst.Blue() = SCREEN_RGB_COLORS[value][2];
-                dst.Alpha() = 255;
+                dst.Red() = pixel[0];
+                dst.Green() = pixel[1];
+                dst.Blue() = pixel[2];
+                dst.Alpha() = pixel[3];
                 dst++;
+                pixel += 4;
             }
         }
-        painting_mutex.Unlock();
     }
 
     int windowWidth, windowHeight;
@@ -99,6 +108,9 @@ void DisplayPanel::on_key_up(wxKeyEvent& event) {
     default: return;
     }
     inputs = utils::set_bit_value(inputs, index, 1);
+    if (emulator_thread) {
+        emulator_thread->gb().joypad().set_inputs(inputs);
+    }
 }
 
 void DisplayPanel::on_key_down(wxKeyEvent& event) {
@@ -119,6 +131,9 @@ void DisplayPanel::on_key_down(wxKeyEvent& event) {
     default: return;
     }
     inputs = utils::set_bit_value(inputs, index, 0);
+    if (emulator_thread) {
+        emulator_thread->gb().joypad().set_inputs(inputs);
+    }
 }
 
 wxBEGIN_EVENT_TABLE(DisplayPanel, wxPanel)
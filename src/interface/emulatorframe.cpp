@@ -7,8 +7,11 @@ extern EmulatorThread* emulator_thread;
 extern bool open_emulator(std::string filename);
 extern void close_emulator();
 
+constexpr uint32_t AUDIO_LATENCIES_MS[] = { 30, 60, 100, 200 };
+constexpr int AUDIO_LATENCY_COUNT = sizeof(AUDIO_LATENCIES_MS) / sizeof(AUDIO_LATENCIES_MS[0]);
+
 EmulatorFrame::EmulatorFrame(const wxString& title, const wxSize& size)
-    : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, size)
+    : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, size), audio_latency_ms(SOUND_DEFAULT_LATENCY_MS)
 {
     DisplayPanel* panel = new DisplayPanel(this);
     SetDropTarget(panel);
@@ -24,12 +27,22 @@ EmulatorFrame::EmulatorFrame(const wxString& title, const wxSize& size)
     menuFile->Append(wxID_EXIT);
     wxMenu* menuEmulation = new wxMenu();
     menuEmulation->Append(CustomMenuIds::ID_PAUSE, "Pause", wxEmptyString, true);
+    wxMenu* menuLatency = new wxMenu();
+    for (int i = 0; i < AUDIO_LATENCY_COUNT; i++) {
+        menuLatency->AppendRadioItem(CustomMenuIds::ID_AUDIO_LATENCY + i, wxString::Format("%u ms", AUDIO_LATENCIES_MS[i]));
+        menuLatency->Check(CustomMenuIds::ID_AUDIO_LATENCY + i, AUDIO_LATENCIES_MS[i] == audio_latency_ms);
+    }
+    menuEmulation->AppendSubMenu(menuLatency, "Audio latency");
 
     wxMenuBar* menuBar = new wxMenuBar();
     menuBar->Append(menuFile, "&File");
     menuBar->Append(menuEmulation, "&Emulation");
     SetMenuBar(menuBar);
 
+    CreateStatusBar();
+    stats_timer.SetOwner(this);
+    stats_timer.Start(1000);
+
     SetMinClientSize(wxSize(160, 144));
 }
 
@@ -62,9 +75,35 @@ void EmulatorFrame::on_emulation_pause(wxCommandEvent& event) {
     }
 }
 
+void EmulatorFrame::on_audio_latency(wxCommandEvent& event) {
+    audio_latency_ms = AUDIO_LATENCIES_MS[event.GetId() - CustomMenuIds::ID_AUDIO_LATENCY];
+    if (emulator_thread) {
+        emulator_thread->set_audio_latency(audio_latency_ms);
+    }
+}
+
+void EmulatorFrame::on_stats_timer(wxTimerEvent& event) {
+    if (!emulator_thread) {
+        SetStatusText(wxEmptyString);
+        return;
+    }
+
+    FrameExchangeStats stats = emulator_thread->frames().stats();
+    SoundStreamer& sound = emulator_thread->sound_stream();
+    SampleRingStats sound_stats = sound.stats();
+    SetStatusText(wxString::Format("%llu frames shown, %llu dropped, %llu duplicated | "
+                                   "audio %zu buffered, rate %+.3f%%, %llu underruns, %llu overruns",
+                                   (unsigned long long) stats.presented, (unsigned long long) stats.dropped,
+                                   (unsigned long long) stats.duplicated, sound.buffered(),
+                                   (emulator_thread->sound_rate_factor() - 1) * 100, (unsigned long long) sound_stats.underruns,
+                                   (unsigned long long) sound_stats.overruns));
+}
+
 wxBEGIN_EVENT_TABLE(EmulatorFrame, wxFrame)
     EVT_MENU(wxID_OPEN, EmulatorFrame::on_file_open)
     EVT_MENU(wxID_CLOSE, EmulatorFrame::on_file_close)
     EVT_MENU(wxID_EXIT, EmulatorFrame::on_file_exit)
     EVT_MENU(CustomMenuIds::ID_PAUSE, EmulatorFrame::on_emulation_pause)
+    EVT_MENU_RANGE(CustomMenuIds::ID_AUDIO_LATENCY, CustomMenuIds::ID_AUDIO_LATENCY + AUDIO_LATENCY_COUNT - 1, EmulatorFrame::on_audio_latency)
+    EVT_TIMER(wxID_ANY, EmulatorFrame::on_stats_timer)
 wxEND_EVENT_TABLE()
\ No newline at end of file
@@ -1,26 +1,39 @@
 #include "soundstreamer.h"
-#include <iostream>
+#include <algorithm>
 
-SoundStreamer::SoundStreamer() {
-    initialize(2, 31775);
-    filled_audio_buffer.reserve(532 * 2 * 2);
-    playing_audio_buffer.reserve(532 * 2);
+SoundStreamer::SoundStreamer(uint32_t latency_ms) {
+    initialize(2, SOUND_SAMPLE_RATE);
+    set_latency(latency_ms);
+}
+
+void SoundStreamer::set_latency(uint32_t latency_ms) {
+    // Whatever a frame doesn't take up is split between the ring's slack and SFML's queue.
+    // The shortest latencies bottom out at the minimum chunk size.
+    double budget = ((SOUND_SAMPLE_RATE * latency_ms) / 1000.0) - (SOUND_SAMPLE_RATE / SOUND_FRAME_RATE);
+    size_t chunk = (size_t) std::max(0.0, budget / (SOUND_SLACK_CHUNKS + SOUND_QUEUED_CHUNKS));
+    _chunk.assign(std::max(chunk, SOUND_MIN_CHUNK_SAMPLES) * 2, 0);
+    _latency_ms = latency_ms;
+    // Nothing is reading while stopped, so this side can throw out what was buffered for
+    // the old latency
+    _samples.discard();
 }
 
 bool SoundStreamer::onGetData(SoundStream::Chunk& data) {
-    mutex.lock();
-    int size = filled_audio_buffer.size();
-    if (size >= 532 * 2) {
-        std::copy_n(filled_audio_buffer.begin(), 532 * 2, playing_audio_buffer.begin());
-        filled_audio_buffer.erase(filled_audio_buffer.begin(), filled_audio_buffer.begin() + 532 * 2);
-    } else {
-        std::cerr << "[AUDIO] didnt have enough samples! (" << size << "/1064)" << std::endl;
+    size_t chunk = chunk_samples();
+    size_t count = _samples.read(_chunk.data(), chunk);
+    if (count < chunk) {
+        // Underrun, counted by the ring. Hold the last sample rather than click back to 0.
+        size_t last = count ? (count - 1) * 2 : (chunk - 1) * 2;
+        sf::Int16 left = _chunk[last];
+        sf::Int16 right = _chunk[last + 1];
+        for (size_t i = count * 2; i < _chunk.size(); i += 2) {
+            _chunk[i] = left;
+            _chunk[i + 1] = right;
+        }
     }
 
-    mutex.unlock();
-
-    data.samples = playing_audio_buffer.data();
-    data.sampleCount = 532 * 2;
+    data.samples = _chunk.data();
+    data.sampleCount = _chunk.size();
     return true;
 }
 
@@ -28,9 +41,7 @@ void SoundStreamer::onSeek(sf::Time timeOffset) {
     // Don't support seeking, we dispose of old samples anyway.
 }
 
-void SoundStreamer::add_sample(sf::Int16 leftSample, sf::Int16 rightSample) {
-    mutex.lock();
-    filled_audio_buffer.push_back(leftSample);
-    filled_audio_buffer.push_back(rightSample);
-    mutex.unlock();
-}
\ No newline at end of file
+void SoundStreamer::add_samples(const sf::Int16* samples, size_t count) {
+    // Overruns are counted by the ring, and the samples that don't fit dropped
+    _samples.write(samples, count);
+}
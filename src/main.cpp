@@ -16,10 +16,9 @@
 #include <wx/wxprec.h>
 #include <wx/wx.h>
 
-#include "gbsystem.h"
+#include "scgbe.h"
 #include "emulatorframe.h"
 #include "emulatorthread.h"
-#include "utils.h"
 
 EmulatorFrame* emulator_frame = nullptr;
 EmulatorThread* emulator_thread = nullptr;
@@ -51,6 +50,7 @@ bool open_emulator(std::string filename) {
     rom_file.close();
 
     emulator_thread = new EmulatorThread(rom);
+    emulator_thread->set_audio_latency(emulator_frame->audio_latency());
     wxThreadError error;
     if ((error = emulator_thread->Run()) != wxTHREAD_NO_ERROR || !emulator_thread->rom_valid()) {
         delete emulator_thread;
@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "scgbe.h"
+
+// Traces the code reachable from the entry point and the RST/interrupt vectors, and
+// writes it out as C++ that runs against scgbe_core. Jumps from bank 0 into the
+// switchable area can't be resolved statically, so their target is traced in every
+// bank. JP HL, code in RAM and anything else not found here is left to the interpreter.
+
+static constexpr size_t MAX_BLOCK_INSTRUCTIONS = 256;
+
+static const char* BYTE_REGISTERS[8] = { "r.b", "r.c", "r.d", "r.e", "r.h", "r.l", nullptr, "r.a" };
+static const char* WORD_REGISTERS[4] = { "bc", "de", "hl", "sp" };
+static const char* CONDITIONS[4] = { "!r.flags.zero()", "r.flags.zero()", "!r.flags.carry()", "r.flags.carry()" };
+
+static std::string hex(uint32_t value, int digits) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+    return buffer;
+}
+
+class Recompiler {
+
+    private:
+    const std::vector<uint8_t>& _rom;
+    size_t _banks;
+    std::set<uint32_t> _instructions; // ROM offsets of every instruction found
+
+    public:
+    uint32_t unresolved_jumps = 0;
+
+    Recompiler(const std::vector<uint8_t>& rom) :
+        _rom(rom),
+        _banks((rom.size() + ROM_SIZE - 1) / ROM_SIZE)
+    {}
+
+    size_t instruction_count() const {
+        return _instructions.size();
+    }
+
+    // Bank 0 runs from 0x0000, the others from 0x4000.
+    static uint16_t address_of(uint32_t offset) {
+        return offset < ROM_SIZE ? offset : ROM_SIZE | (offset & (ROM_SIZE - 1));
+    }
+
+    static uint32_t bank_end(uint32_t offset) {
+        return (offset | (ROM_SIZE - 1)) + 1;
+    }
+
+    // ROM offsets jumping from the code at offset to target can end up at.
+    std::vector<uint32_t> resolve(uint32_t offset, uint16_t target) const {
+        std::vector<uint32_t> offsets;
+        if (target < ROM_SIZE) {
+            offsets.push_back(target);
+        } else if (target < 2 * ROM_SIZE) {
+            if (offset >= ROM_SIZE) {
+                offsets.push_back((offset & ~(ROM_SIZE - 1)) + (target - ROM_SIZE));
+            } else {
+                for (size_t bank = 1; bank < _banks; bank++) {
+                    offsets.push_back(bank * ROM_SIZE + (target - ROM_SIZE));
+                }
+            }
+        }
+        return offsets;
+    }
+
+    // Whether a whole, valid instruction starts at offset.
+    bool decodable(uint32_t offset) const {
+        uint8_t opcode = _rom[offset];
+        uint32_t end = offset + CPU::instruction_length(opcode);
+        return CPU::valid_opcode(opcode) && end <= _rom.size() && end <= bank_end(offset);
+    }
+
+    void trace() {
+        std::vector<uint32_t> pending = { 0x100 };
+        for (uint16_t vector = 0; vector <= 0x38; vector += 0x08) {
+            pending.push_back(RST_VECTORS + vector);
+        }
+        for (uint16_t vector = 0; vector <= 0x20; vector += 0x08) {
+            pending.push_back(INTERRUPT_VECTORS + vector);
+        }
+
+        while (!pending.empty()) {
+            uint32_t offset = pending.back();
+            pending.pop_back();
+
+            while (offset < _rom.size() && !_instructions.count(offset) && decodable(offset)) {
+                _instructions.insert(offset);
+                uint8_t opcode = _rom[offset];
+                uint32_t next = offset + CPU::instruction_length(opcode);
+
+                uint16_t target;
+                if (jump_target(offset, target)) {
+                    for (uint32_t target_offset : resolve(offset, target)) {
+                        pending.push_back(target_offset);
+                    }
+                } else if (opcode == 0xE9) {
+                    unresolved_jumps++;
+                }
+                if (ends_flow(opcode)) {
+                    break;
+                }
+                offset = next;
+            }
+        }
+    }
+
+    void write(std::ostream& out, const std::string& name, const std::string& source) const {
+        out << "// Generated by scgbe-recompile from " << source << ", do not edit." << std::endl
+            << "#include \"recompiledcontext.h\"" << std::endl
+            << std::endl
+            << "namespace {" << std::endl;
+
+        // Runs of consecutive instructions, each becoming one function
+        std::vector<std::vector<uint32_t>> blocks;
+        uint32_t expected = 0;
+        for (uint32_t offset : _instructions) {
+            if (blocks.empty() || offset != expected || blocks.back().size() >= MAX_BLOCK_INSTRUCTIONS
+                || ends_block(_rom[blocks.back().back()])) {
+                blocks.emplace_back();
+            }
+            blocks.back().push_back(offset);
+            expected = offset + CPU::instruction_length(_rom[offset]);
+        }
+
+        for (const std::vector<uint32_t>& block : blocks) {
+            write_block(out, block);
+        }
+
+        out << std::endl << "const RecompiledEntry entries[] = {" << std::endl;
+        for (const std::vector<uint32_t>& block : blocks) {
+            for (size_t i = 0; i < block.size(); i++) {
+                out << "    { " << hex(block[i], 6) << ", " << function_name(block[0]) << ", " << i << " }," << std::endl;
+            }
+        }
+        out << "};" << std::endl
+            << std::endl
+            << "const RecompiledModule module = {" << std::endl
+            << "    \"" << name << "\", 0x" << std::hex << RecompiledModule::hash_rom(_rom.data(), _rom.size()) << std::dec << "ULL, "
+            << _rom.size() << "," << std::endl
+            << "    entries, sizeof(entries) / sizeof(entries[0])" << std::endl
+            << "};" << std::endl
+            << "RecompiledModuleRegistration registration(module);" << std::endl
+            << std::endl
+            << "}" << std::endl;
+    }
+
+    private:
+    // JP, JR, RET, RETI and JP HL: what follows isn't run right after them.
+    static bool ends_flow(uint8_t opcode) {
+        switch (opcode) {
+        case 0x18: case 0xC3: case 0xC9: case 0xD9: case 0xE9: return true;
+        default: return false;
+        }
+    }
+
+    // HALT and STOP also hand back to the interpreter, which waits for the wake up.
+    static bool ends_block(uint8_t opcode) {
+        return ends_flow(opcode) || opcode == 0x76 || opcode == 0x10;
+    }
+
+    // Target address of a JR, JP, CALL or RST at offset.
+    bool jump_target(uint32_t offset, uint16_t& target) const {
+        uint8_t opcode = _rom[offset];
+        uint16_t next = address_of(offset) + CPU::instruction_length(opcode);
+        uint16_t immediate = (offset + 2 < _rom.size()) ? (_rom[offset + 2] << 8) | _rom[offset + 1] : 0;
+        switch (opcode) {
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            target = next + (int8_t) _rom[offset + 1];
+            return true;
+        case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+        case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+            target = immediate;
+            return true;
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+            target = opcode & 0x38;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static std::string function_name(uint32_t offset) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "block_%06X", offset);
+        return buffer;
+    }
+
+    static std::string label(uint32_t offset) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "at_%06X", offset);
+        return buffer;
+    }
+
+    void write_block(std::ostream& out, const std::vector<uint32_t>& block) const {
+        // Jumps within the block stay in it
+        std::map<uint32_t, size_t> positions;
+        for (size_t i = 0; i < block.size(); i++) {
+            positions[block[i]] = i;
+        }
+        auto local_target = [&](uint32_t offset, uint32_t& target_offset) {
+            uint16_t target;
+            if (!jump_target(offset, target)) {
+                return false;
+            }
+            std::vector<uint32_t> offsets = resolve(offset, target);
+            if (offsets.size() != 1 || !positions.count(offsets[0])) {
+                return false;
+            }
+            target_offset = offsets[0];
+            return true;
+        };
+        std::set<uint32_t> labels;
+        for (uint32_t offset : block) {
+            uint8_t opcode = _rom[offset];
+            uint32_t target_offset;
+            bool relative_or_absolute_jump = opcode == 0x18 || opcode == 0xC3 || (opcode < 0x40 && (opcode & 0xE7) == 0x20)
+                || (opcode >= 0xC0 && (opcode & 0xE7) == 0xC2);
+            if (relative_or_absolute_jump && local_target(offset, target_offset)) {
+                labels.insert(target_offset);
+            }
+        }
+
+        out << std::endl
+            << "uint32_t " << function_name(block[0]) << "(RecompiledContext& c, uint32_t entry) {" << std::endl
+            << "    Registers& r = c.r;" << std::endl
+            << "    uint32_t n = 0;" << std::endl
+            << "    switch (entry) {" << std::endl;
+
+        bool accessed = false; // Whether the previous instruction touched memory or called a handler
+        for (size_t i = 0; i < block.size(); i++) {
+            uint32_t offset = block[i];
+            uint8_t opcode = _rom[offset];
+            uint8_t length = CPU::instruction_length(opcode);
+
+            out << "    case " << i << ":" << std::endl;
+            if (labels.count(offset)) {
+                out << "    " << label(offset) << ":" << std::endl;
+            }
+            out << "        if (n && " << (accessed ? "c.stop_after_access()" : "c.stop()") << ") return n;" << std::endl;
+            out << "        // " << hex(address_of(offset), 4).substr(2) << ":";
+            for (uint8_t j = 0; j < length; j++) {
+                out << " " << hex(_rom[offset + j], 2).substr(2);
+            }
+            out << std::endl;
+
+            std::string jump;
+            uint32_t target_offset;
+            if (local_target(offset, target_offset)) {
+                jump = "goto " + label(target_offset) + ";";
+            } else {
+                jump = "return n;";
+            }
+            accessed = write_instruction(out, offset, jump);
+        }
+
+        out << "    }" << std::endl
+            << "    return n;" << std::endl
+            << "}" << std::endl;
+    }
+
+    // Writes one instruction, `jump` continues after a taken JR/JP. Returns whether it
+    // touched memory or called into the interpreter.
+    bool write_instruction(std::ostream& out, uint32_t offset, const std::string& jump) const {
+        uint8_t opcode = _rom[offset];
+        uint8_t length = CPU::instruction_length(opcode);
+        uint8_t operand0 = (length > 1) ? _rom[offset + 1] : 0;
+        uint8_t operand1 = (length > 2) ? _rom[offset + 2] : 0;
+        uint16_t immediate = (operand1 << 8) | operand0;
+        std::string next = hex((uint16_t) (address_of(offset) + length), 4);
+        std::string n8 = hex(operand0, 2);
+        std::string n16 = hex(immediate, 4);
+        uint16_t target = 0;
+        jump_target(offset, target);
+
+        uint8_t x = opcode >> 6;
+        uint8_t y = (opcode >> 3) & 0b111;
+        uint8_t z = opcode & 0b111;
+        uint8_t p = y >> 1;
+        uint8_t q = y & 1;
+
+        auto line = [&out](const std::string& text) {
+            out << "        " << text << std::endl;
+        };
+        auto simple = [&](const std::string& body, int cycles) {
+            line("r.pc = " + next + ";");
+            if (!body.empty()) {
+                line(body);
+            }
+            line("c.tick(" + std::to_string(cycles) + "); n++;");
+        };
+        auto set_word = [&](uint8_t pair, const std::string& value) {
+            return pair == 3 ? "r.sp = " + value + ";" : "r.set_" + std::string(WORD_REGISTERS[pair]) + "(" + value + ");";
+        };
+        auto get_word = [&](uint8_t pair) {
+            return pair == 3 ? std::string("r.sp") : "r." + std::string(WORD_REGISTERS[pair]) + "()";
+        };
+        auto conditional = [&](const std::string& taken, int taken_cycles, const std::string& after, int cycles) {
+            line("if (" + std::string(CONDITIONS[y & 0b11]) + ") {");
+            out << "            " << taken << " c.tick(" << taken_cycles << "); n++; " << after << std::endl;
+            line("}");
+            simple("", cycles);
+        };
+
+        if (opcode == 0x00) {
+            simple("", 1);
+            return false;
+
+        } else if (x == 0 && z == 1 && q == 0) {
+            // LD rr, nn
+            simple(set_word(p, n16), 3);
+            return false;
+
+        } else if (x == 0 && z == 2) {
+            // LD (rr), A / LD A, (rr)
+            std::string pointer = (p == 0) ? "r.bc()" : (p == 1) ? "r.de()" : "address";
+            std::string step = (p == 2) ? " r.set_hl(address + 1);" : (p == 3) ? " r.set_hl(address - 1);" : "";
+            std::string body = (p >= 2) ? "{ uint16_t address = r.hl();" : "{";
+            if (q == 0) {
+                body += step + " c.write(" + pointer + ", r.a); }";
+            } else {
+                body += " uint8_t value = c.read(" + pointer + ");" + step + " r.a = value; }";
+            }
+            simple(body, 2);
+            return true;
+
+        } else if (x == 0 && z == 3) {
+            // INC rr / DEC rr
+            simple(set_word(p, get_word(p) + (q == 0 ? " + 1" : " - 1")), 2);
+            return false;
+
+        } else if (x == 0 && (z == 4 || z == 5) && y != 6) {
+            // INC r / DEC r
+            std::string reg = BYTE_REGISTERS[y];
+            simple(reg + " = r.flags.record_" + (z == 4 ? "inc(" : "dec(") + reg + ");", 1);
+            return false;
+
+        } else if (x == 0 && z == 6) {
+            // LD r, n
+            if (y == 6) {
+                simple("c.write(r.hl(), " + n8 + ");", 3);
+                return true;
+            }
+            simple(std::string(BYTE_REGISTERS[y]) + " = " + n8 + ";", 2);
+            return false;
+
+        } else if (opcode == 0x18 || opcode == 0xC3) {
+            // JR e / JP nn
+            line("r.pc = " + hex(target, 4) + ";");
+            line("c.tick(" + std::to_string(opcode == 0x18 ? 3 : 4) + "); n++;");
+            line(jump);
+            return false;
+
+        } else if (x == 0 && z == 0 && y >= 4) {
+            // JR cc, e
+            conditional("r.pc = " + hex(target, 4) + ";", 3, jump, 2);
+            return false;
+
+        } else if (x == 1 && opcode != 0x76) {
+            // LD r, r'
+            if (z == 6) {
+                simple(std::string(BYTE_REGISTERS[y]) + " = c.read(r.hl());", 2);
+                return true;
+            } else if (y == 6) {
+                simple("c.write(r.hl(), " + std::string(BYTE_REGISTERS[z]) + ");", 2);
+                return true;
+            }
+            simple(y == z ? "" : std::string(BYTE_REGISTERS[y]) + " = " + BYTE_REGISTERS[z] + ";", 1);
+            return false;
+
+        } else if (x == 2 || (x == 3 && z == 6)) {
+            // ALU A, r / ALU A, n
+            bool indirect = x == 2 && z == 6;
+            std::string value = (x == 3) ? n8 : indirect ? "c.read(r.hl())" : BYTE_REGISTERS[z];
+            std::string body;
+            switch (y) {
+            case 0: body = "r.a = r.flags.record_add(r.a, " + value + ", 0);"; break;
+            case 1: body = "r.a = r.flags.record_add(r.a, " + value + ", r.flags.carry());"; break;
+            case 2: body = "r.a = r.flags.record_sub(r.a, " + value + ", 0);"; break;
+            case 3: body = "r.a = r.flags.record_sub(r.a, " + value + ", r.flags.carry());"; break;
+            case 4: body = "r.a &= " + value + "; r.flags.record_and(r.a);"; break;
+            case 5: body = "r.a ^= " + value + "; r.flags.record_or(r.a);"; break;
+            case 6: body = "r.a |= " + value + "; r.flags.record_or(r.a);"; break;
+            default: body = "r.flags.record_sub(r.a, " + value + ", 0);"; break;
+            }
+            simple(body, (x == 3 || indirect) ? 2 : 1);
+            return indirect;
+
+        } else if (x == 3 && z == 0 && y < 4) {
+            // RET cc
+            conditional("r.pc = c.pop();", 5, "return n;", 2);
+            return true;
+
+        } else if (x == 3 && z == 1 && q == 0) {
+            // POP rr
+            simple(p == 3 ? "r.set_af(c.pop());" : set_word(p, "c.pop()"), 3);
+            return true;
+
+        } else if (x == 3 && z == 5 && q == 0) {
+            // PUSH rr
+            simple("c.push(" + (p == 3 ? std::string("r.af()") : get_word(p)) + ");", 4);
+            return true;
+
+        } else if (x == 3 && z == 2 && y < 4) {
+            // JP cc, nn
+            conditional("r.pc = " + hex(target, 4) + ";", 4, jump, 3);
+            return false;
+
+        } else if (x == 3 && z == 4 && y < 4) {
+            // CALL cc, nn
+            conditional("r.pc = " + next + "; c.push(" + next + "); r.pc = " + hex(target, 4) + ";", 6, "return n;", 3);
+            return true;
+
+        } else if (opcode == 0xCD || (x == 3 && z == 7)) {
+            // CALL nn / RST
+            line("r.pc = " + next + ";");
+            line("c.push(" + next + ");");
+            line("r.pc = " + hex(target, 4) + ";");
+            line("c.tick(" + std::to_string(opcode == 0xCD ? 6 : 4) + "); n++;");
+            line("return n;");
+            return true;
+
+        } else if (opcode == 0xC9) {
+            // RET
+            line("r.pc = c.pop();");
+            line("c.tick(4); n++;");
+            line("return n;");
+            return true;
+
+        } else if (opcode == 0xE0 || opcode == 0xF0) {
+            // LDH (n), A / LDH A, (n)
+            std::string address = hex(0xFF00 + operand0, 4);
+            simple(opcode == 0xE0 ? "c.write(" + address + ", r.a);" : "r.a = c.read(" + address + ");", 3);
+            return true;
+
+        } else if (opcode == 0xE2 || opcode == 0xF2) {
+            // LD (C), A / LD A, (C)
+            simple(opcode == 0xE2 ? "c.write(0xFF00 + r.c, r.a);" : "r.a = c.read(0xFF00 + r.c);", 2);
+            return true;
+
+        } else if (opcode == 0xEA || opcode == 0xFA) {
+            // LD (nn), A / LD A, (nn)
+            simple(opcode == 0xEA ? "c.write(" + n16 + ", r.a);" : "r.a = c.read(" + n16 + ");", 4);
+            return true;
+
+        } else if (opcode == 0xE9) {
+            // JP HL
+            line("r.pc = r.hl();");
+            line("c.tick(1); n++;");
+            line("return n;");
+            return false;
+        }
+
+        // Everything else goes through the interpreter's handler
+        line("r.pc = " + next + ";");
+        std::string operands;
+        if (length > 1) {
+            operands = ", " + hex(operand0, 2) + (length > 2 ? ", " + hex(operand1, 2) : "");
+        }
+        line("c.tick(c.call(" + hex(opcode, 2) + operands + ")); n++;");
+        if (ends_block(opcode)) {
+            // RETI, HALT and STOP
+            line("return n;");
+        }
+        return true;
+    }
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <rom> <output.cpp> [--name NAME]" << std::endl
+              << "Link the output into a program using scgbe_core, then select" << std::endl
+              << "CPUBackend::Recompiled after loading the ROM." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string rom_path = argv[1];
+    std::string output_path = argv[2];
+    std::string name = rom_path.substr(rom_path.find_last_of("/\\") + 1);
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::ifstream rom_file(rom_path, std::ios::binary);
+    if (!rom_file.is_open()) {
+        std::cerr << "Failed to open " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(rom_file)), std::istreambuf_iterator<char>());
+    if (rom.size() < 0x150) {
+        std::cerr << "Not a ROM: " << rom_path << std::endl;
+        return 1;
+    }
+    for (char& c : name) {
+        if (c == '"' || c == '\\') {
+            c = '_';
+        }
+    }
+
+    Recompiler recompiler(rom);
+    recompiler.trace();
+
+    std::ofstream output(output_path);
+    if (!output.is_open()) {
+        std::cerr << "Failed to open " << output_path << std::endl;
+        return 1;
+    }
+    recompiler.write(output, name, rom_path.substr(rom_path.find_last_of("/\\") + 1));
+
+    std::cout << recompiler.instruction_count() << " instructions translated, "
+              << recompiler.unresolved_jumps << " JP HL left to the interpreter" << std::endl;
+    return 0;
+}